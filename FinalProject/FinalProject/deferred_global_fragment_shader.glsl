@@ -0,0 +1,114 @@
+#version 330 core
+out vec4 FragColor;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// light sources, positions are already in view space (LightUniforms in uniform_blocks.h)
+#define MAX_POINT_LIGHTS 8
+struct PointLightData
+{
+    vec4 position;
+    vec4 color;
+};
+layout (std140) uniform LightData
+{
+    PointLightData lights[MAX_POINT_LIGHTS];
+    int lightCount;
+};
+
+// directional sun and its shadow cascades, matrices map view space to the shadow map (ShadowUniforms in uniform_blocks.h)
+#define SHADOW_CASCADES 4
+layout (std140) uniform ShadowData
+{
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    vec4 cascadeSplits;
+    vec4 cascadeTexels;
+    vec4 sunDirection;
+    vec4 sunColor;
+};
+uniform sampler2DArrayShadow shadowMap;
+
+// 1 lit, 0 shadowed: 3x3 taps of hardware PCF in the first cascade that covers the fragment, looked up a
+// texel and a half along the normal so surfaces don't shadow themselves
+float sunVisibility(vec3 position, vec3 normal)
+{
+    float depth = -position.z;
+    if (depth > cascadeSplits[SHADOW_CASCADES - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+    vec4 coord = cascadeMatrices[cascade] * vec4(position + normal * cascadeTexels[cascade] * 1.5, 1.0);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), min(coord.z, 1.0)));
+    return lit / 9.0;
+}
+
+// G-buffer written by the geometry pass (DeferredRenderer in deferred_renderer.h)
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// view space position from the depth buffer, using the perspective terms of the projection matrix
+vec3 viewPosition(vec2 uv, float depth)
+{
+    float viewZ = -projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+    vec2 ndc = uv * 2.0 - 1.0;
+    return vec3(ndc.x * -viewZ / projection[0][0], ndc.y * -viewZ / projection[1][1], viewZ);
+}
+
+// full-screen pass: the scene lights of LightData and the sun, with the same terms as the forward phong shader
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;    // background keeps the clear color
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 norm = octDecode(texelFetch(gNormal, pixel, 0).xy * 2.0 - 1.0);
+    vec3 fragPos = viewPosition(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)), depth);
+    vec3 viewDir = normalize(-fragPos);
+
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+    for (int i = 0; i < lightCount; ++i)
+    {
+        vec3 lightColor = lights[i].color.rgb;
+        ambient += 0.1 * lightColor;
+        vec3 lightDir = normalize(lights[i].position.xyz - fragPos);
+        diffuse += max(dot(norm, lightDir), 0.0) * lightColor;
+        vec3 reflectDir = reflect(-lightDir, norm);
+        specular += albedoSpecular.a * pow(max(dot(viewDir, reflectDir), 0.0), 32) * lightColor;
+    }
+
+    // directional sun, dimmed by the cascades when they were drawn this frame
+    float sunDiffuse = max(dot(norm, sunDirection.xyz), 0.0);
+    float visibility = 1.0;
+    if (sunColor.a > 0.0 && sunDiffuse > 0.0)
+        visibility = sunVisibility(fragPos, norm);
+    diffuse += visibility * sunDiffuse * sunColor.rgb;
+    vec3 sunReflect = reflect(-sunDirection.xyz, norm);
+    specular += visibility * albedoSpecular.a * pow(max(dot(viewDir, sunReflect), 0.0), 32) * sunColor.rgb;
+    FragColor = vec4((ambient + diffuse + specular) * albedoSpecular.rgb, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#version 330 core
+out vec4 FragColor;
+
+flat in int LightIndex;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+uniform samplerBuffer clusterLights;
+
+// G-buffer written by the geometry pass (DeferredRenderer in deferred_renderer.h)
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+// view space position from the depth buffer, using the perspective terms of the projection matrix
+vec3 viewPosition(vec2 uv, float depth)
+{
+    float viewZ = -projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+    vec2 ndc = uv * 2.0 - 1.0;
+    return vec3(ndc.x * -viewZ / projection[0][0], ndc.y * -viewZ / projection[1][1], viewZ);
+}
+
+// one light volume's contribution, added to the frame; pixels outside the radius add nothing
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if (depth == 1.0)
+        discard;
+    vec4 positionRadius = texelFetch(clusterLights, 2 * LightIndex);
+    vec3 fragPos = viewPosition(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)), depth);
+    vec3 toLight = positionRadius.xyz - fragPos;
+    float lightDistance = length(toLight);
+    if (lightDistance >= positionRadius.w)
+        discard;
+
+    vec3 lightColor = texelFetch(clusterLights, 2 * LightIndex + 1).rgb;
+    vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+    vec3 norm = octDecode(texelFetch(gNormal, pixel, 0).xy * 2.0 - 1.0);
+
+    // same falloff as the clustered forward path
+    float window = clamp(1.0 - pow(lightDistance / positionRadius.w, 4.0), 0.0, 1.0);
+    float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+    vec3 lightDir = toLight / max(lightDistance, 0.0001);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float diff = max(dot(norm, lightDir), 0.0);
+    float spec = albedoSpecular.a * pow(max(dot(normalize(-fragPos), reflectDir), 0.0), 32);
+    FragColor = vec4((diff * albedoSpecular.rgb + spec * albedoSpecular.rgb) * attenuation * lightColor, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+flat out int LightIndex;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// view space position and radius, color of every clustered light (LightClusterer in light_clusters.h)
+uniform samplerBuffer clusterLights;
+
+// one instance per light: a cube around its sphere of influence, placed in view space
+void main()
+{
+    vec4 positionRadius = texelFetch(clusterLights, 2 * gl_InstanceID);
+    LightIndex = gl_InstanceID;
+    gl_Position = projection * vec4(positionRadius.xyz + aPos * positionRadius.w, 1.0);
+}
\ No newline at end of file
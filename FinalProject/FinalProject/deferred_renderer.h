@@ -0,0 +1,201 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "light_clusters.h"
+#include "shader.h"
+#include "shadow_maps.h"
+#include "uniform_blocks.h"
+
+#include <iostream>
+#include <memory>
+
+// texture units the lighting passes read the G-buffer from, after the clustered light buffers
+#define GBUFFER_ALBEDO_UNIT 7
+#define GBUFFER_NORMAL_UNIT 8
+#define GBUFFER_DEPTH_UNIT 9
+
+// Deferred shading, the alternative to the forward phong pass. The geometry pass draws the render queue into
+// a compact G-buffer, 8 bytes per pixel plus depth:
+//     0  RGBA8  albedo (texture_diffuse or the object color), specular strength (texture_specular)
+//     1  RG16   view space normal, octahedral encoded
+//     depth     DEPTH24, also the source of the view space position
+// Lighting then costs per lit pixel instead of per shaded fragment: one full-screen pass applies the scene
+// lights of LightData and the sun (shadowed by the ShadowMapper's cascades), and every clustered point light
+// is drawn as an instanced cube around its radius that adds its contribution. The cubes cull their front
+// faces, so a camera inside a light's volume is still lit.
+//
+// The geometry pass uses the regular render queue with G-buffer programs (SceneObject::deferredShader).
+class DeferredRenderer
+{
+public:
+    // lighting programs and the light volume cube; the G-buffer itself is sized on first use
+    // ------------------------------------------------------------------------
+    void create()
+    {
+        globalShader.reset(new Shader("deferred_fullscreen_vertex_shader.glsl", "deferred_global_fragment_shader.glsl"));
+        lightShader.reset(new Shader("deferred_light_vertex_shader.glsl", "deferred_light_fragment_shader.glsl"));
+        Shader* shaders[2] = { globalShader.get(), lightShader.get() };
+        for (int i = 0; i < 2; i++)
+        {
+            bindUniformBlocks(shaders[i]->ID);
+            shaders[i]->use();
+            shaders[i]->setInt("gAlbedoSpecular", GBUFFER_ALBEDO_UNIT);
+            shaders[i]->setInt("gNormal", GBUFFER_NORMAL_UNIT);
+            shaders[i]->setInt("gDepth", GBUFFER_DEPTH_UNIT);
+            shaders[i]->setInt("clusterLights", CLUSTER_LIGHT_UNIT);
+        }
+        globalShader->setInt("shadowMap", SHADOW_MAP_UNIT);
+
+        // the full-screen triangle comes from gl_VertexID, but a core context still wants a VAO bound
+        glGenVertexArrays(1, &emptyVAO);
+
+        // cube [-1,1]^3, scaled by each light's radius
+        float corners[] = {
+            -1.0f, -1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f, 1.0f, -1.0f,  -1.0f, 1.0f, -1.0f,
+            -1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f,  1.0f, 1.0f,  1.0f,  -1.0f, 1.0f,  1.0f
+        };
+        unsigned int faces[] = {
+            0, 2, 1,  0, 3, 2,     // back
+            4, 5, 6,  4, 6, 7,     // front
+            0, 4, 7,  0, 7, 3,     // left
+            1, 2, 6,  1, 6, 5,     // right
+            0, 1, 5,  0, 5, 4,     // bottom
+            3, 7, 6,  3, 6, 2      // top
+        };
+        glGenVertexArrays(1, &volumeVAO);
+        glGenBuffers(1, &volumeVBO);
+        glGenBuffers(1, &volumeEBO);
+        glState().bindVertexArray(volumeVAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, volumeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, volumeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glState().bindVertexArray(0);
+    }
+
+    // delete the G-buffer, programs and geometry, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        releaseTargets();
+        if (volumeVAO != 0)
+        {
+            glState().deleteVertexArray(volumeVAO);
+            glState().deleteVertexArray(emptyVAO);
+            glState().deleteBuffer(volumeVBO);
+            glState().deleteBuffer(volumeEBO);
+            volumeVAO = emptyVAO = volumeVBO = volumeEBO = 0;
+        }
+        if (globalShader)
+            glState().deleteProgram(globalShader->ID);
+        if (lightShader)
+            glState().deleteProgram(lightShader->ID);
+        globalShader.reset();
+        lightShader.reset();
+    }
+
+    // bind and clear the G-buffer (resized to the framebuffer first); the render queue is drawn next
+    // ------------------------------------------------------------------------
+    void beginGeometry(int width, int height)
+    {
+        if (width != this->width || height != this->height)
+            createTargets(width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // light the G-buffer into the default framebuffer, which must already be cleared to the background color
+    // ------------------------------------------------------------------------
+    void light(unsigned int clusteredLights)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().bindTexture(GBUFFER_ALBEDO_UNIT, GL_TEXTURE_2D, albedoSpecular);
+        glState().bindTexture(GBUFFER_NORMAL_UNIT, GL_TEXTURE_2D, normal);
+        glState().bindTexture(GBUFFER_DEPTH_UNIT, GL_TEXTURE_2D, depth);
+        glState().disable(GL_DEPTH_TEST);
+
+        glState().useProgram(globalShader->ID);
+        glState().bindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        if (clusteredLights > 0)
+        {
+            glState().enable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glState().enable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glState().useProgram(lightShader->ID);
+            glState().bindVertexArray(volumeVAO);
+            glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(clusteredLights));
+            glCullFace(GL_BACK);
+            glState().disable(GL_CULL_FACE);
+            glState().disable(GL_BLEND);
+        }
+        glState().enable(GL_DEPTH_TEST);
+    }
+
+private:
+    std::unique_ptr<Shader> globalShader;
+    std::unique_ptr<Shader> lightShader;
+    GLuint emptyVAO = 0;
+    GLuint volumeVAO = 0, volumeVBO = 0, volumeEBO = 0;
+
+    int width = 0, height = 0;
+    GLuint framebuffer = 0;
+    GLuint albedoSpecular = 0, normal = 0, depth = 0;
+
+    void createTargets(int width, int height)
+    {
+        releaseTargets();
+        this->width = width;
+        this->height = height;
+
+        albedoSpecular = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        normal = createTarget(GL_RG16, GL_RG, GL_UNSIGNED_SHORT);
+        depth = createTarget(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoSpecular, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // screen sized, sampled texel by texel with texelFetch
+    GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(0, GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    void releaseTargets()
+    {
+        if (framebuffer == 0)
+            return;
+        glDeleteFramebuffers(1, &framebuffer);
+        glState().deleteTexture(albedoSpecular);
+        glState().deleteTexture(normal);
+        glState().deleteTexture(depth);
+        framebuffer = albedoSpecular = normal = depth = 0;
+        width = height = 0;
+    }
+};
+#endif
@@ -0,0 +1,29 @@
+#version 330 core
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// same dither as fragment_shader.glsl lodCovered
+const float DITHER[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+bool lodCovered(float coverage)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (DITHER[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+    return coverage >= 0.0 ? threshold < coverage : threshold >= -coverage;
+}
+
+// depth only, for the packets of a fading LOD (RenderQueue::executeDepthOnly): the dither has to match the
+// color pass, or it would find the other level's depth in its pixels. The discard would cost early depth
+// tests, so every other packet goes through the plain depth_prepass_fragment_shader.glsl
+void main()
+{
+    if (!lodCovered(objectColor.a))
+        discard;
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#version 330 core
+
+// depth only: the color pass runs the real shading once per visible pixel afterwards
+void main()
+{
+}
\ No newline at end of file
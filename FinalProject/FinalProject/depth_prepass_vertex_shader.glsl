@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// same expression as the color pass shaders, so both passes produce the same depth
+void main()
+{
+    gl_Position = modelViewProjection * vec4(aPos, 1.0);
+}
\ No newline at end of file
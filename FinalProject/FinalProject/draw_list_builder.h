@@ -0,0 +1,200 @@
+#ifndef DRAW_LIST_BUILDER_H
+#define DRAW_LIST_BUILDER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "geometry_registry.h"
+#include "model.h"
+#include "shader.h"
+#include "occlusion_culler.h"
+#include "render_queue.h"
+#include "transform_stage.h"
+#include "worker_pool.h"
+
+#include <vector>
+
+class ShaderVariants;
+
+// how an object takes part in the shadow cascades (shadow_maps.h)
+enum ShadowCasting {
+    SHADOW_NONE = 0,
+    SHADOW_STATIC,      // never moves: cached in the distant cascades
+    SHADOW_DYNAMIC      // drawn into every cascade it touches, every frame
+};
+
+// one drawable instance: a model, or raw geometry in a VAO
+struct SceneObject {
+    const Model* model = nullptr;   // nullptr: draw the raw geometry below
+    Shader* shader = nullptr;
+    ShaderVariants* variants = nullptr;     // non-null: `shader` is re-picked from these every frame
+    unsigned int features = 0;              // PermutationFeature flags the object needs
+    Shader* deferredShader = nullptr;       // G-buffer program for the deferred path, nullptr: `shader` in both
+
+    GLuint vao = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLsizei count = 0;
+    GLenum indexType = 0;           // 0 = glDrawArrays
+    glm::vec3 boundsMin = glm::vec3(-0.5f); // object space, raw geometry only (meshes carry their own)
+    glm::vec3 boundsMax = glm::vec3(0.5f);
+    glm::vec4 color = glm::vec4(1.0f);      // rgb; a is replaced by the LOD crossfade coverage
+    const GeometryLod* lod = nullptr;       // non-null: the geometry above is picked from these levels per frame
+                                            // (shadow casters keep drawing vao/count)
+
+    // world transform = translate(position) * rotate(time * rotationSpeed, rotationAxis) * scale(scale)
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float rotationSpeed = 0.0f;     // radians per second
+
+    RenderPass pass = PASS_OPAQUE;
+    ShadowCasting shadow = SHADOW_STATIC;
+};
+
+// Builds the frame's draw packets on the worker pool. The objects are cut into fixed ranges; each job fills
+// its range of the SIMD transform stage and computes its matrices, or culls its range against the CPU
+// occlusion buffer and writes packets into its own list. The lists are appended to the RenderQueue in range
+// order, so the result is the same as a single-threaded build, and the GL thread only sorts and executes.
+class DrawListBuilder
+{
+public:
+    explicit DrawListBuilder(WorkerPool& pool) : pool(pool) {}
+
+    // world, model-view, model-view-projection and normal matrices of all objects at `time`
+    // ------------------------------------------------------------------------
+    void updateTransforms(const std::vector<SceneObject>& objects, float time, const glm::mat4& view, const glm::mat4& projection)
+    {
+        // pixels covered by one unit of radius at one unit of view depth, for the LOD picks in build()
+        lodPixelScale = projection[1][1] * 0.5f * static_cast<float>(viewportHeight);
+        transforms.resize(objects.size());
+        transforms.setCamera(view, projection);
+        pool.parallelFor(rangeCount(objects.size()), [&](unsigned int range) {
+            std::size_t end = rangeEnd(range, objects.size());
+            for (std::size_t i = range * RANGE; i < end; i++)
+            {
+                const SceneObject& object = objects[i];
+                glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+                if (object.rotationSpeed != 0.0f)
+                    rotation = glm::angleAxis(time * object.rotationSpeed, glm::normalize(object.rotationAxis));
+                transforms.set(i, object.position, rotation, object.scale);
+            }
+            // RANGE is a whole number of SIMD groups, so ranges never share one
+            transforms.compute(range * RANGE, end);
+        });
+    }
+
+    // framebuffer height the LOD levels are picked for; takes effect with the next updateTransforms()
+    void setViewportHeight(int height) { viewportHeight = height; }
+
+    // world matrix, valid after updateTransforms(), e.g. to place occluders
+    const glm::mat4& transform(std::size_t object) const { return transforms.matrices(object).world; }
+
+    // cull (when a culler is given) and packetize every object in parallel, then append the packets to the
+    // queue; the queue must have been begun for this frame. `deferred` draws with the G-buffer programs
+    // ------------------------------------------------------------------------
+    void build(const std::vector<SceneObject>& objects, RenderQueue& queue, const OcclusionCuller* culler, bool deferred = false)
+    {
+        unsigned int ranges = rangeCount(objects.size());
+        if (lists.size() < ranges)
+            lists.resize(ranges);
+        pool.parallelFor(ranges, [&](unsigned int range) {
+            std::vector<DrawPacket>& list = lists[range];
+            list.clear();
+            std::size_t end = rangeEnd(range, objects.size());
+            for (std::size_t i = range * RANGE; i < end; i++)
+                buildObject(objects[i], transforms.matrices(i), queue, culler, deferred, lodPixelScale, list);
+        });
+        for (unsigned int range = 0; range < ranges; range++)
+            queue.append(lists[range]);
+    }
+
+private:
+    static const std::size_t RANGE = 256;  // objects per job, a multiple of TransformStage::LANES
+
+    WorkerPool& pool;
+    TransformStage transforms;
+    int viewportHeight = 600;
+    float lodPixelScale = 0.0f;
+    std::vector<std::vector<DrawPacket> > lists;   // one per range, reused across frames
+
+    static unsigned int rangeCount(std::size_t objects)
+    {
+        return static_cast<unsigned int>((objects + RANGE - 1) / RANGE);
+    }
+
+    static std::size_t rangeEnd(unsigned int range, std::size_t objects)
+    {
+        std::size_t end = (range + 1) * RANGE;
+        return end < objects ? end : objects;
+    }
+
+    static void buildObject(const SceneObject& object, const ObjectMatrices& matrices, const RenderQueue& queue,
+                            const OcclusionCuller* culler, bool deferred, float lodPixelScale, std::vector<DrawPacket>& list)
+    {
+        Shader& shader = deferred && object.deferredShader != nullptr ? *object.deferredShader : *object.shader;
+        const glm::mat4& transform = matrices.world;
+        if (object.model != nullptr)
+        {
+            for (unsigned int m = 0; m < object.model->meshes.size(); m++)
+            {
+                const Mesh& mesh = object.model->meshes[m];
+                if (culler != nullptr && !culler->visible(mesh.boundsMin, mesh.boundsMax, transform))
+                    continue;
+                DrawPacket packet = queue.meshPacket(mesh, shader, transform, object.pass);
+                packet.matrices = &matrices;
+                list.push_back(packet);
+            }
+            return;
+        }
+
+        if (culler != nullptr && !culler->visible(object.boundsMin, object.boundsMax, transform))
+            return;
+        if (object.lod == nullptr || object.lod->count == 0)
+        {
+            list.push_back(geometryPacket(object, matrices, queue, shader, object.vao, object.count, object.indexType, 1.0f));
+            return;
+        }
+
+        // inside a fade band the finer level covers `fade` of the pixels and this level the rest
+        float fade;
+        int level = object.lod->select(screenRadius(*object.lod, matrices, lodPixelScale), fade);
+        const SharedGeometry& geometry = *object.lod->levels[level];
+        list.push_back(geometryPacket(object, matrices, queue, shader, geometry.vao, geometry.count, GL_UNSIGNED_INT,
+                                      fade > 0.0f ? -fade : 1.0f));
+        if (fade > 0.0f)
+        {
+            const SharedGeometry& finer = *object.lod->levels[level - 1];
+            list.push_back(geometryPacket(object, matrices, queue, shader, finer.vao, finer.count, GL_UNSIGNED_INT, fade));
+        }
+    }
+
+    static DrawPacket geometryPacket(const SceneObject& object, const ObjectMatrices& matrices, const RenderQueue& queue,
+                                     Shader& shader, GLuint vao, GLsizei count, GLenum indexType, float coverage)
+    {
+        DrawPacket packet = queue.geometryPacket(shader, vao, object.mode, count, indexType, matrices.world, object.pass);
+        packet.matrices = &matrices;
+        packet.color = glm::vec4(glm::vec3(object.color), coverage);
+        packet.object = &object;
+        packet.boundsMin = object.boundsMin;
+        packet.boundsMax = object.boundsMax;
+        return packet;
+    }
+
+    // radius in pixels of the LOD's bounding sphere, scaled by the largest axis scale; objects the camera is in
+    // or close to get the finest level
+    static float screenRadius(const GeometryLod& lod, const ObjectMatrices& matrices, float lodPixelScale)
+    {
+        const glm::mat4& world = matrices.world;
+        float scale = glm::max(glm::length(glm::vec3(world[0])), glm::max(glm::length(glm::vec3(world[1])),
+                                                                           glm::length(glm::vec3(world[2]))));
+        float radius = lod.radius * scale;
+        float depth = -matrices.modelView[3].z;
+        if (depth <= radius)
+            return 1e30f;
+        return radius * lodPixelScale / depth;
+    }
+
+    DrawListBuilder(const DrawListBuilder&) = delete;
+    DrawListBuilder& operator=(const DrawListBuilder&) = delete;
+};
+#endif
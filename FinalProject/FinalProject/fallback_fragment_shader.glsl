@@ -0,0 +1,18 @@
+#version 330 core
+out vec4 FragColor;
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// stands in for a program that is still compiling: flat per-object color, no lighting or textures
+void main()
+{
+    FragColor = vec4(objectColor.rgb * 0.5, 1.0);
+}
\ No newline at end of file
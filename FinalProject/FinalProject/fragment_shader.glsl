@@ -5,52 +5,179 @@ out vec4 FragColor;
 
 in vec3 FragPos;
 in vec3 Normal;
-in vec3 lightPos;   // extra in variable, since we need the light position in view space we calculate this in the vertex shader
 
-uniform vec3 lightColor;
-uniform vec3 objectColor;
+// permutations (shader_variants.h) define LIGHT_COUNT and the features they use; the generic program has all
+#ifndef PERMUTATION
+#define SPECULAR 1
+#define CLUSTERED 1
+#define SHADOWED 1
+#define LOD_FADE 1
+#endif
 
-// second light source
-uniform vec3 lightPos2;
-uniform vec3 lightColor2;
+// light sources, positions are already in view space (LightUniforms in uniform_blocks.h)
+#define MAX_POINT_LIGHTS 8
+struct PointLightData
+{
+    vec4 position;
+    vec4 color;
+};
+layout (std140) uniform LightData
+{
+    PointLightData lights[MAX_POINT_LIGHTS];
+    int lightCount;
+};
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// directional sun and its shadow cascades, matrices map view space to the shadow map (ShadowUniforms in uniform_blocks.h)
+#define SHADOW_CASCADES 4
+layout (std140) uniform ShadowData
+{
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    vec4 cascadeSplits;
+    vec4 cascadeTexels;
+    vec4 sunDirection;
+    vec4 sunColor;
+};
+#ifdef SHADOWED
+uniform sampler2DArrayShadow shadowMap;
+
+// 1 lit, 0 shadowed: 3x3 taps of hardware PCF in the first cascade that covers the fragment, looked up a
+// texel and a half along the normal so surfaces don't shadow themselves
+float sunVisibility(vec3 position, vec3 normal)
+{
+    float depth = -position.z;
+    if (depth > cascadeSplits[SHADOW_CASCADES - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+    vec4 coord = cascadeMatrices[cascade] * vec4(position + normal * cascadeTexels[cascade] * 1.5, 1.0);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), min(coord.z, 1.0)));
+    return lit / 9.0;
+}
+#endif
+
+#ifdef CLUSTERED
+// clustered point lights (ClusterUniforms and LightClusterer in light_clusters.h)
+layout (std140) uniform ClusterData
+{
+    vec4 clusterScreen;
+    vec4 clusterSlicing;
+    ivec4 clusterGrid;
+};
+uniform usamplerBuffer clusterCells;
+uniform usamplerBuffer clusterIndices;
+uniform samplerBuffer clusterLights;
+#endif
+
+#ifdef LOD_FADE
+// LOD crossfade (GeometryLod in geometry_registry.h): objectColor.a is the share of pixels this draw covers on
+// a 4x4 ordered dither, a negative value the complementary share, so the two levels of a fading object
+// together cover every pixel exactly once; 1 covers everything
+// gbuffer_fragment_shader.glsl and depth_prepass_dithered_fragment_shader.glsl hold copies of this table and
+// function: change all three together, or the two levels stop covering each pixel exactly once
+const float DITHER[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+bool lodCovered(float coverage)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (DITHER[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+    return coverage >= 0.0 ? threshold < coverage : threshold >= -coverage;
+}
+#endif
 
 void main()
 {
-    // ambient
+#ifdef LOD_FADE
+    if (!lodCovered(objectColor.a))
+        discard;
+#endif
     float ambientStrength = 0.1;
-    vec3 ambient = ambientStrength * lightColor;   
-    vec3 ambient2 = ambientStrength * lightColor2; // second light source
-    
-     // diffuse 
+    float specularStrength = 0.5;
+
     vec3 norm = normalize(Normal);
-    // vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 viewDir = normalize(-FragPos); // the viewer is always at (0,0,0) in view-space, so viewDir is (0,0,0) - Position => -Position
 
-    // both light sources
-    vec3 lightDir1 = normalize(lightPos - FragPos);
-    vec3 lightDir2 = normalize(lightPos2 - FragPos);
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+#ifdef LIGHT_COUNT
+    // constant bound: the loop unrolls and lights beyond the count aren't in the program at all
+    for (int i = 0; i < LIGHT_COUNT; ++i)
+#else
+    for (int i = 0; i < lightCount; ++i)
+#endif
+    {
+        vec3 lightColor = lights[i].color.rgb;
 
-    // float diff = max(dot(norm, lightDir), 0.0);
-    // vec3 diffuse = diff * lightColor;
+        // ambient
+        ambient += ambientStrength * lightColor;
 
-    // second light source
-    float diff1 = max(dot(norm, lightDir1), 0.0);
-    float diff2 = max(dot(norm, lightDir2), 0.0);
-    vec3 diffuse = diff1 * lightColor + diff2 * lightColor2;
-    
-    // specular
-    float specularStrength = 0.5;
-    vec3 viewDir = normalize(-FragPos); // the viewer is always at (0,0,0) in view-space, so viewDir is (0,0,0) - Position => -Position
-    // vec3 reflectDir = reflect(-lightDir, norm);  
-    // float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-    // vec3 specular = specularStrength * spec * lightColor; 
-
-    // both light sources
-    vec3 reflectDir1 = reflect(-lightDir1, norm);
-    vec3 reflectDir2 = reflect(-lightDir2, norm);
-    float spec1 = pow(max(dot(viewDir, reflectDir1), 0.0), 32);
-    float spec2 = pow(max(dot(viewDir, reflectDir2), 0.0), 32);
-    vec3 specular = specularStrength * (spec1 * lightColor + spec2 * lightColor2);
-    
-    vec3 result = (ambient + ambient2 + diffuse + specular) * objectColor;
+        // diffuse 
+        vec3 lightDir = normalize(lights[i].position.xyz - FragPos);
+        float diff = max(dot(norm, lightDir), 0.0);
+        diffuse += diff * lightColor;
+
+#ifdef SPECULAR
+        // specular
+        vec3 reflectDir = reflect(-lightDir, norm);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+        specular += specularStrength * spec * lightColor;
+#endif
+    }
+
+    // directional sun, dimmed by the cascades when they were drawn this frame
+    float sunDiffuse = max(dot(norm, sunDirection.xyz), 0.0);
+    float visibility = 1.0;
+#ifdef SHADOWED
+    if (sunColor.a > 0.0 && sunDiffuse > 0.0)
+        visibility = sunVisibility(FragPos, norm);
+#endif
+    diffuse += visibility * sunDiffuse * sunColor.rgb;
+#ifdef SPECULAR
+    vec3 sunReflect = reflect(-sunDirection.xyz, norm);
+    specular += visibility * specularStrength * pow(max(dot(viewDir, sunReflect), 0.0), 32) * sunColor.rgb;
+#endif
+
+#ifdef CLUSTERED
+    // only the lights assigned to the cluster this fragment falls in
+    float viewDepth = max(-FragPos.z, clusterSlicing.z);
+    int slice = clamp(int(log(viewDepth) * clusterSlicing.x + clusterSlicing.y), 0, clusterGrid.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy * clusterScreen.zw), ivec2(0), clusterGrid.xy - 1);
+    uvec2 cell = texelFetch(clusterCells, (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x).xy;
+    for (uint i = 0u; i < cell.y; ++i)
+    {
+        int light = int(texelFetch(clusterIndices, int(cell.x + i)).x);
+        vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+        vec3 lightColor = texelFetch(clusterLights, 2 * light + 1).rgb;
+
+        // falloff that reaches zero at the radius, so lights outside the cluster really contribute nothing
+        vec3 toLight = positionRadius.xyz - FragPos;
+        float lightDistance = length(toLight);
+        float window = clamp(1.0 - pow(lightDistance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / (lightDistance * lightDistance + 1.0);
+
+        vec3 lightDir = toLight / max(lightDistance, 0.0001);
+        diffuse += max(dot(norm, lightDir), 0.0) * attenuation * lightColor;
+#ifdef SPECULAR
+        vec3 reflectDir = reflect(-lightDir, norm);
+        specular += specularStrength * pow(max(dot(viewDir, reflectDir), 0.0), 32) * attenuation * lightColor;
+#endif
+    }
+#endif
+
+    vec3 result = (ambient + diffuse + specular) * objectColor.rgb;
     FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
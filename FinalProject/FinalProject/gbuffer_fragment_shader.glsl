@@ -0,0 +1,42 @@
+#version 330 core
+layout (location = 0) out vec4 GAlbedoSpecular;
+layout (location = 1) out vec2 GNormal;
+
+in vec3 FragPos;
+in vec3 Normal;
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// octahedral normal encoding: the unit sphere folded onto a square, two channels instead of three
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
+
+// same dither as fragment_shader.glsl lodCovered
+const float DITHER[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+bool lodCovered(float coverage)
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float threshold = (DITHER[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+    return coverage >= 0.0 ? threshold < coverage : threshold >= -coverage;
+}
+
+// G-buffer pass of the untextured objects: the flat object color, the same specular strength as the forward shader
+void main()
+{
+    if (!lodCovered(objectColor.a))
+        discard;
+    GAlbedoSpecular = vec4(objectColor.rgb, 0.5);
+    GNormal = octEncode(normalize(Normal)) * 0.5 + 0.5;
+}
\ No newline at end of file
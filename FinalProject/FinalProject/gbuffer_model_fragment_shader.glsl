@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) out vec4 GAlbedoSpecular;
+layout (location = 1) out vec2 GNormal;
+
+in vec2 TexCoords;
+in vec3 Normal;
+flat in ivec2 MaterialLayers;
+
+// material atlas arrays, the layer to sample comes with each draw
+uniform sampler2DArray materialDiffuse;
+uniform sampler2DArray materialSpecular;
+
+// octahedral normal encoding: the unit sphere folded onto a square, two channels instead of three
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signs;
+}
+
+// G-buffer pass of the textured models: albedo from texture_diffuse, specular strength from texture_specular
+void main()
+{
+    GAlbedoSpecular.rgb = texture(materialDiffuse, vec3(TexCoords, MaterialLayers.x)).rgb;
+    GAlbedoSpecular.a = texture(materialSpecular, vec3(TexCoords, MaterialLayers.y)).r;
+    GNormal = octEncode(normalize(Normal)) * 0.5 + 0.5;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+out vec3 Normal;
+flat out ivec2 MaterialLayers;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+uniform ivec2 materialLayers; // diffuse/specular layer of the mesh's material in the atlas arrays
+
+void main()
+{
+    TexCoords = aTexCoords;
+    MaterialLayers = materialLayers;
+    Normal = normalMatrix * aNormal;
+    gl_Position = modelViewProjection * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,315 @@
+#ifndef GEOMETRY_REGISTRY_H
+#define GEOMETRY_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "sphere.h"
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+// one uploaded mesh, shared by every object that draws it; the VAO has position (0), normal (1) and
+// texture coordinate (2) interleaved, and the index buffer holds the triangles followed by the line list
+struct SharedGeometry {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    GLsizei count = 0;              // triangle indices, GL_UNSIGNED_INT from offset 0
+    GLsizei lineCount = 0;          // line indices (wireframe), right after the triangles
+    GLintptr lineOffset = 0;        // byte offset of the line indices
+    glm::vec3 boundsMin = glm::vec3(-1.0f);
+    glm::vec3 boundsMax = glm::vec3(1.0f);
+};
+
+// Tessellation levels of one shape, finest first, picked per object and frame by the projected radius of its
+// bounding sphere (DrawListBuilder): a level is used while the sphere covers at least its minScreenRadius
+// pixels, the last level catches everything smaller. Objects that are no more than `fadeBand` (a fraction of
+// the threshold) short of the next finer level draw both levels, dithered into each other by their coverage
+// in objectColor.a, so a switch never pops; 0 switches hard.
+struct GeometryLod {
+    enum { MAX_LEVELS = 6 };
+
+    const SharedGeometry* levels[MAX_LEVELS] = {};
+    float minScreenRadius[MAX_LEVELS] = {};
+    int count = 0;
+    float radius = 1.0f;            // object space bounding sphere around the origin
+    float fadeBand = 0.0f;
+
+    // append a coarser level, used down to `screenRadius` pixels
+    void add(const SharedGeometry& geometry, float screenRadius)
+    {
+        if (count == MAX_LEVELS)
+            return;
+        levels[count] = &geometry;
+        minScreenRadius[count] = screenRadius;
+        count++;
+    }
+
+    // level for a bounding sphere of `screenRadius` pixels; `fade` is the coverage of the next finer level
+    // (level - 1) drawn over it, 0 when the object is outside every fade band
+    int select(float screenRadius, float& fade) const
+    {
+        fade = 0.0f;
+        int level = 0;
+        while (level < count - 1 && screenRadius < minScreenRadius[level])
+            level++;
+        if (level > 0 && fadeBand > 0.0f)
+        {
+            float upper = minScreenRadius[level - 1];
+            float lower = glm::max(upper * (1.0f - fadeBand), minScreenRadius[level]);
+            if (upper > lower && screenRadius > lower)
+                fade = (screenRadius - lower) / (upper - lower);
+        }
+        return level;
+    }
+};
+
+// Procedural meshes, built and uploaded once per unique set of parameters. Spheres are unit spheres keyed by
+// (sectors, stacks, smooth, up axis): the radius goes into the object's scale, so any number of spheres of any
+// size share a single VAO and pair of buffers. The Sphere keeps no arrays: its vertices and indices are
+// generated straight into the mapped buffers, so there is no CPU copy to allocate, fill and copy again.
+// Icospheres (a subdivided icosahedron) spread their triangles evenly instead of crowding them at the poles.
+//
+// The returned references stay valid until release().
+class GeometryRegistry
+{
+public:
+    // the unit sphere with these parameters, built on first request (GL thread only)
+    // ------------------------------------------------------------------------
+    const SharedGeometry& sphere(int sectorCount = 36, int stackCount = 18, bool smooth = true, int up = 3)
+    {
+        // normalize the way Sphere::set does, so equivalent requests share an entry
+        if (sectorCount < 2)
+            sectorCount = 2;
+        if (stackCount < 2)
+            stackCount = 2;
+        if (up < 1 || up > 3)
+            up = 3;
+        SphereKey key(sectorCount, stackCount, smooth, up);
+        std::map<SphereKey, std::unique_ptr<SharedGeometry> >::iterator it = spheres.find(key);
+        if (it != spheres.end())
+            return *it->second;
+
+        Sphere sphere(1.0f, sectorCount, stackCount, smooth, up, false);
+        SharedGeometry* geometry = new SharedGeometry();
+        upload(sphere, *geometry);
+        spheres[key].reset(geometry);
+        return *geometry;
+    }
+
+    // the unit icosphere: an icosahedron with every triangle split in four `subdivisions` times (20 * 4^n
+    // triangles), smooth shaded; texture coordinates are the Z-up sphere's, without a seam fix
+    // ------------------------------------------------------------------------
+    const SharedGeometry& icosphere(int subdivisions = 3)
+    {
+        subdivisions = glm::clamp(subdivisions, 0, 7);
+        std::map<int, std::unique_ptr<SharedGeometry> >::iterator it = icospheres.find(subdivisions);
+        if (it != icospheres.end())
+            return *it->second;
+
+        SharedGeometry* geometry = new SharedGeometry();
+        uploadIcosphere(subdivisions, *geometry);
+        icospheres[subdivisions].reset(geometry);
+        return *geometry;
+    }
+
+    // a ready-made level chain for spheres, from about 4000 triangles for spheres over 200 pixels in radius
+    // down to less than a hundred below 20 pixels
+    // ------------------------------------------------------------------------
+    GeometryLod sphereLod(bool useIcosphere = false)
+    {
+        GeometryLod lod;
+        if (useIcosphere)
+        {
+            lod.add(icosphere(4), 200.0f);      // 5120 triangles
+            lod.add(icosphere(3), 60.0f);       // 1280
+            lod.add(icosphere(2), 20.0f);       // 320
+            lod.add(icosphere(1), 0.0f);        // 80
+        }
+        else
+        {
+            lod.add(sphere(64, 32), 200.0f);    // 3968 triangles
+            lod.add(sphere(36, 18), 60.0f);     // 1224
+            lod.add(sphere(18, 9), 20.0f);      // 288
+            lod.add(sphere(8, 4), 0.0f);        // 48
+        }
+        return lod;
+    }
+
+    // number of distinct meshes uploaded
+    std::size_t size() const { return spheres.size() + icospheres.size(); }
+
+    // delete every VAO and buffer, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (std::map<SphereKey, std::unique_ptr<SharedGeometry> >::iterator it = spheres.begin(); it != spheres.end(); ++it)
+            releaseGeometry(*it->second);
+        for (std::map<int, std::unique_ptr<SharedGeometry> >::iterator it = icospheres.begin(); it != icospheres.end(); ++it)
+            releaseGeometry(*it->second);
+        spheres.clear();
+        icospheres.clear();
+    }
+
+private:
+    typedef std::tuple<int, int, bool, int> SphereKey;     // sectors, stacks, smooth, up axis
+
+    std::map<SphereKey, std::unique_ptr<SharedGeometry> > spheres;
+    std::map<int, std::unique_ptr<SharedGeometry> > icospheres;   // by subdivision count
+
+    static void releaseGeometry(SharedGeometry& geometry)
+    {
+        glState().deleteVertexArray(geometry.vao);
+        glState().deleteBuffer(geometry.vbo);
+        glState().deleteBuffer(geometry.ibo);
+    }
+
+    // VAO over a new vertex/index buffer pair with the interleaved layout; the data may be NULL to be written
+    // later. The VAO is left bound
+    static void allocate(SharedGeometry& geometry, GLsizeiptr vertexSize, const void* vertices,
+                         GLsizeiptr indexSize, const void* indices)
+    {
+        glGenVertexArrays(1, &geometry.vao);
+        glGenBuffers(1, &geometry.vbo);
+        glGenBuffers(1, &geometry.ibo);
+        glState().bindVertexArray(geometry.vao);
+
+        // triangles and lines in one buffer, so both draw with the same VAO
+        glState().bindBuffer(GL_ARRAY_BUFFER, geometry.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexSize, vertices, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, indices, GL_STATIC_DRAW);
+
+        const int stride = 8 * sizeof(float);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+    }
+
+    static void upload(Sphere& sphere, SharedGeometry& geometry)
+    {
+        geometry.count = static_cast<GLsizei>(sphere.getIndexCount());
+        geometry.lineCount = static_cast<GLsizei>(sphere.getLineIndexCount());
+        geometry.lineOffset = static_cast<GLintptr>(sphere.getIndexSize());
+
+        GLsizeiptr vertexSize = sphere.getInterleavedVertexSize();
+        GLsizeiptr indexSize = sphere.getIndexSize() + sphere.getLineIndexSize();
+        allocate(geometry, vertexSize, NULL, indexSize, NULL);
+
+        // an unmap can fail when the driver loses the storage meanwhile (e.g. a mode switch): write it again
+        for (int attempt = 0; attempt < 2; attempt++)
+        {
+            const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+            float* vertices = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexSize, access));
+            unsigned int* indices = static_cast<unsigned int*>(glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexSize, access));
+            if (vertices == nullptr || indices == nullptr)
+            {
+                std::cout << "ERROR::GEOMETRY:: could not map the sphere buffers" << std::endl;
+                if (vertices != nullptr)
+                    glUnmapBuffer(GL_ARRAY_BUFFER);
+                if (indices != nullptr)
+                    glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+                break;
+            }
+            sphere.generate(vertices, indices, indices + sphere.getIndexCount());
+            GLboolean vertexOk = glUnmapBuffer(GL_ARRAY_BUFFER);
+            GLboolean indexOk = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
+            if (vertexOk && indexOk)
+                break;
+            if (attempt == 1)
+                std::cout << "ERROR::GEOMETRY:: sphere buffer contents were lost while mapped" << std::endl;
+        }
+        glState().bindVertexArray(0);
+    }
+
+    static void uploadIcosphere(int subdivisions, SharedGeometry& geometry)
+    {
+        // the 12 corners of an icosahedron: three orthogonal golden rectangles
+        const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+        std::vector<glm::vec3> positions = {
+            glm::vec3(-1, t, 0), glm::vec3(1, t, 0), glm::vec3(-1, -t, 0), glm::vec3(1, -t, 0),
+            glm::vec3(0, -1, t), glm::vec3(0, 1, t), glm::vec3(0, -1, -t), glm::vec3(0, 1, -t),
+            glm::vec3(t, 0, -1), glm::vec3(t, 0, 1), glm::vec3(-t, 0, -1), glm::vec3(-t, 0, 1)
+        };
+        for (std::size_t i = 0; i < positions.size(); i++)
+            positions[i] = glm::normalize(positions[i]);
+        std::vector<unsigned int> triangles = {
+            0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+            1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+            3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+            4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1
+        };
+
+        // split every triangle into four; an edge's midpoint is shared by both triangles on it
+        for (int level = 0; level < subdivisions; level++)
+        {
+            std::map<uint64_t, unsigned int> midpoints;
+            auto midpoint = [&](unsigned int a, unsigned int b) {
+                uint64_t key = a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+                std::map<uint64_t, unsigned int>::iterator it = midpoints.find(key);
+                if (it != midpoints.end())
+                    return it->second;
+                unsigned int index = static_cast<unsigned int>(positions.size());
+                positions.push_back(glm::normalize(positions[a] + positions[b]));
+                midpoints[key] = index;
+                return index;
+            };
+            std::vector<unsigned int> split;
+            split.reserve(triangles.size() * 4);
+            for (std::size_t i = 0; i < triangles.size(); i += 3)
+            {
+                unsigned int a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+                unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+                unsigned int quarters[12] = { a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca };
+                split.insert(split.end(), quarters, quarters + 12);
+            }
+            triangles.swap(split);
+        }
+
+        // unit sphere: the normal is the position; s around Z from +X, t from the +Z pole like Sphere
+        const float PI = std::acos(-1.0f);
+        std::vector<float> vertices;
+        vertices.reserve(positions.size() * 8);
+        for (std::size_t i = 0; i < positions.size(); i++)
+        {
+            const glm::vec3& p = positions[i];
+            float s = std::atan2(p.y, p.x) / (2.0f * PI);
+            float v[8] = { p.x, p.y, p.z, p.x, p.y, p.z, s < 0.0f ? s + 1.0f : s, std::acos(glm::clamp(p.z, -1.0f, 1.0f)) / PI };
+            vertices.insert(vertices.end(), v, v + 8);
+        }
+
+        // every edge once: a closed mesh has each edge in two triangles, in opposite directions
+        std::vector<unsigned int> indices(triangles);
+        for (std::size_t i = 0; i < triangles.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                unsigned int a = triangles[i + e], b = triangles[i + (e + 1) % 3];
+                if (a < b)
+                {
+                    indices.push_back(a);
+                    indices.push_back(b);
+                }
+            }
+        }
+
+        geometry.count = static_cast<GLsizei>(triangles.size());
+        geometry.lineCount = static_cast<GLsizei>(indices.size() - triangles.size());
+        geometry.lineOffset = static_cast<GLintptr>(triangles.size() * sizeof(unsigned int));
+        allocate(geometry, static_cast<GLsizeiptr>(vertices.size() * sizeof(float)), vertices.data(),
+                 static_cast<GLsizeiptr>(indices.size() * sizeof(unsigned int)), indices.data());
+        glState().bindVertexArray(0);
+    }
+};
+#endif
@@ -0,0 +1,162 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// The vendored glad loaders (lib/glad1 and lib/glad2) were both generated for core 3.3 only, so the entry
+// points of the optional newer paths are fetched here through the same loader function glad was given.
+// Every pointer stays null (and its has* flag false) when the context doesn't provide it; callers check the
+// flag and fall back to the 3.3 path.
+
+// GL 4.0 / 4.3 (ARB_draw_indirect, ARB_multi_draw_indirect, ARB_shader_storage_buffer_object)
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+#define GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT 0x90DF
+#endif
+
+// GL 4.4 (ARB_buffer_storage)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+// GL 4.1 (ARB_get_program_binary)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// KHR_parallel_shader_compile (ARB_parallel_shader_compile uses the same values)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT)(GLuint count);
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC_EXT)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC_EXT)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC_EXT)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC_EXT)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP PFNGLMULTIDRAWARRAYSINDIRECTPROC_EXT)(GLenum mode, const void* indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC_EXT)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+// layout of one GL_DRAW_INDIRECT_BUFFER entry for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint  baseVertex;
+    GLuint baseInstance;
+};
+
+struct GLExtensions {
+    int major = 3;
+    int minor = 3;
+
+    // multi-draw indirect with SSBO per-draw data and gl_DrawID (core 4.6)
+    bool hasMultiDrawIndirect = false;
+    PFNGLMULTIDRAWARRAYSINDIRECTPROC_EXT MultiDrawArraysIndirect = nullptr;
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC_EXT MultiDrawElementsIndirect = nullptr;
+
+    // immutable buffer storage, needed for persistent mapping (core 4.4 or ARB_buffer_storage)
+    bool hasBufferStorage = false;
+    PFNGLBUFFERSTORAGEPROC_EXT BufferStorage = nullptr;
+
+    // program binaries for the shader cache (core 4.1 or ARB_get_program_binary, with at least one format)
+    bool hasProgramBinary = false;
+    PFNGLGETPROGRAMBINARYPROC_EXT GetProgramBinary = nullptr;
+    PFNGLPROGRAMBINARYPROC_EXT ProgramBinary = nullptr;
+    PFNGLPROGRAMPARAMETERIPROC_EXT ProgramParameteri = nullptr;
+
+    // compiles and links run on driver threads, finished ones report GL_COMPLETION_STATUS_KHR
+    bool hasParallelShaderCompile = false;
+    PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT MaxShaderCompilerThreads = nullptr;
+
+    bool version(int wantMajor, int wantMinor) const
+    {
+        return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+    }
+
+    // linear scan of the extension list, only used at startup
+    bool hasExtension(const char* name) const
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (ext != nullptr && std::strcmp(ext, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+inline GLExtensions& glExt()
+{
+    static GLExtensions ext;
+    return ext;
+}
+
+// call once after gladLoadGLLoader succeeded, with the same loader function
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensions& ext = glExt();
+    ext.major = GLVersion.major;
+    ext.minor = GLVersion.minor;
+
+    if (ext.version(4, 4) || ext.hasExtension("GL_ARB_buffer_storage"))
+    {
+        ext.BufferStorage = (PFNGLBUFFERSTORAGEPROC_EXT)load("glBufferStorage");
+        ext.hasBufferStorage = ext.BufferStorage != nullptr;
+    }
+
+    if (ext.version(4, 1) || ext.hasExtension("GL_ARB_get_program_binary"))
+    {
+        ext.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC_EXT)load("glGetProgramBinary");
+        ext.ProgramBinary = (PFNGLPROGRAMBINARYPROC_EXT)load("glProgramBinary");
+        ext.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC_EXT)load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ext.hasProgramBinary = ext.GetProgramBinary != nullptr && ext.ProgramBinary != nullptr &&
+                               ext.ProgramParameteri != nullptr && formats > 0;
+    }
+
+    if (ext.hasExtension("GL_KHR_parallel_shader_compile"))
+    {
+        ext.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT)load("glMaxShaderCompilerThreadsKHR");
+        ext.hasParallelShaderCompile = true;
+    }
+    else if (ext.hasExtension("GL_ARB_parallel_shader_compile"))
+    {
+        ext.MaxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC_EXT)load("glMaxShaderCompilerThreadsARB");
+        ext.hasParallelShaderCompile = true;
+    }
+    // 0xFFFFFFFF = let the driver pick the number of compiler threads
+    if (ext.MaxShaderCompilerThreads != nullptr)
+        ext.MaxShaderCompilerThreads(0xFFFFFFFFu);
+
+    if (ext.version(4, 6))
+    {
+        ext.MultiDrawArraysIndirect = (PFNGLMULTIDRAWARRAYSINDIRECTPROC_EXT)load("glMultiDrawArraysIndirect");
+        ext.MultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC_EXT)load("glMultiDrawElementsIndirect");
+        ext.hasMultiDrawIndirect = ext.MultiDrawArraysIndirect != nullptr && ext.MultiDrawElementsIndirect != nullptr;
+    }
+}
+#endif
@@ -0,0 +1,330 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+#include "gl_ext.h"
+
+#include <cstddef>
+
+// Shadowed copy of the OpenGL binding state. Every bind/enable in the renderer goes through this cache so
+// that calls which would not change anything (re-binding the current program, VAO, buffer or texture) never
+// reach the driver. Counts of issued and skipped calls are kept per frame.
+//
+// Code that binds objects behind the cache's back must call invalidate() afterwards, otherwise the shadow
+// copy no longer matches the context.
+class GLStateCache
+{
+public:
+    struct FrameStats
+    {
+        unsigned int callsIssued = 0;
+        unsigned int callsSkipped = 0;
+    };
+
+    static const unsigned int MAX_TEXTURE_UNITS = 32;
+
+    // one cache per GL context; this project only ever creates one
+    static GLStateCache& instance()
+    {
+        static GLStateCache cache;
+        return cache;
+    }
+
+    // start a new frame: the counters of the frame just finished become available through lastFrame()
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        previous = current;
+        current = FrameStats();
+    }
+    const FrameStats& lastFrame() const { return previous; }
+    const FrameStats& thisFrame() const { return current; }
+
+    // forget everything we know about the context, the next call of every kind is issued
+    // ------------------------------------------------------------------------
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        elementBuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (std::size_t i = 0; i < BUFFER_SLOTS; i++)
+            buffers[i] = UNKNOWN;
+        for (std::size_t t = 0; t < INDEXED_TARGETS; t++)
+            for (std::size_t i = 0; i < INDEXED_SLOTS; i++)
+                indexedBuffers[t][i] = UNKNOWN;
+        for (unsigned int u = 0; u < MAX_TEXTURE_UNITS; u++)
+            for (std::size_t t = 0; t < TEXTURE_SLOTS; t++)
+                textures[u][t] = UNKNOWN;
+        for (std::size_t i = 0; i < CAPABILITY_SLOTS; i++)
+            capabilities[i] = UNKNOWN_CAP;
+    }
+
+    // programs and vertex arrays
+    // ------------------------------------------------------------------------
+    void useProgram(GLuint id)
+    {
+        if (program == id)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        glUseProgram(id);
+        program = id;
+        current.callsIssued++;
+    }
+    GLuint currentProgram() const { return program; }
+
+    void bindVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        glBindVertexArray(id);
+        vertexArray = id;
+        // the element array binding belongs to the VAO, so whatever we knew about it no longer holds
+        elementBuffer = UNKNOWN;
+        current.callsIssued++;
+    }
+    GLuint currentVertexArray() const { return vertexArray; }
+
+    // buffers
+    // ------------------------------------------------------------------------
+    void bindBuffer(GLenum target, GLuint id)
+    {
+        GLuint* slot = bufferSlot(target);
+        if (slot != nullptr && *slot == id)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        glBindBuffer(target, id);
+        if (slot != nullptr)
+            *slot = id;
+        current.callsIssued++;
+    }
+
+    // indexed binding (UBO/SSBO binding points); like glBindBufferBase this also sets the generic binding
+    void bindBufferBase(GLenum target, GLuint index, GLuint id)
+    {
+        GLuint* slot = indexedSlot(target, index);
+        if (slot != nullptr && *slot == id)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        glBindBufferBase(target, index, id);
+        if (slot != nullptr)
+            *slot = id;
+        GLuint* generic = bufferSlot(target);
+        if (generic != nullptr)
+            *generic = id;
+        current.callsIssued++;
+    }
+
+    // ranged indexed binding; offsets usually change per draw, so these are always issued
+    void bindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        glBindBufferRange(target, index, id, offset, size);
+        GLuint* slot = indexedSlot(target, index);
+        if (slot != nullptr)
+            *slot = UNKNOWN;
+        GLuint* generic = bufferSlot(target);
+        if (generic != nullptr)
+            *generic = id;
+        current.callsIssued++;
+    }
+
+    // textures
+    // ------------------------------------------------------------------------
+    void activeTexture(unsigned int unit)
+    {
+        if (activeUnit == unit)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        current.callsIssued++;
+    }
+
+    // binds a texture to the given unit, only switching the active unit when the bind is really needed
+    void bindTexture(unsigned int unit, GLenum target, GLuint id)
+    {
+        GLuint* slot = textureSlot(unit, target);
+        if (slot != nullptr && *slot == id)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        activeTexture(unit);
+        glBindTexture(target, id);
+        if (slot != nullptr)
+            *slot = id;
+        current.callsIssued++;
+    }
+
+    // capabilities (glEnable/glDisable)
+    // ------------------------------------------------------------------------
+    void enable(GLenum cap) { setCapability(cap, true); }
+    void disable(GLenum cap) { setCapability(cap, false); }
+    void setCapability(GLenum cap, bool on)
+    {
+        unsigned char* slot = capabilitySlot(cap);
+        unsigned char wanted = on ? 1 : 0;
+        if (slot != nullptr && *slot == wanted)
+        {
+            current.callsSkipped++;
+            return;
+        }
+        if (on)
+            glEnable(cap);
+        else
+            glDisable(cap);
+        if (slot != nullptr)
+            *slot = wanted;
+        current.callsIssued++;
+    }
+
+    // object deletion: a deleted name may be handed out again by glGen*, so it must not stay cached as bound
+    // ------------------------------------------------------------------------
+    void deleteProgram(GLuint id)
+    {
+        if (program == id)
+            program = 0;
+        glDeleteProgram(id);
+    }
+    void deleteVertexArray(GLuint id)
+    {
+        if (vertexArray == id)
+        {
+            vertexArray = 0;
+            elementBuffer = UNKNOWN;
+        }
+        glDeleteVertexArrays(1, &id);
+    }
+    void deleteBuffer(GLuint id)
+    {
+        for (std::size_t i = 0; i < BUFFER_SLOTS; i++)
+            if (buffers[i] == id)
+                buffers[i] = 0;
+        for (std::size_t t = 0; t < INDEXED_TARGETS; t++)
+            for (std::size_t i = 0; i < INDEXED_SLOTS; i++)
+                if (indexedBuffers[t][i] == id)
+                    indexedBuffers[t][i] = 0;
+        if (elementBuffer == id)
+            elementBuffer = UNKNOWN;
+        glDeleteBuffers(1, &id);
+    }
+    void deleteTexture(GLuint id)
+    {
+        for (unsigned int u = 0; u < MAX_TEXTURE_UNITS; u++)
+            for (std::size_t t = 0; t < TEXTURE_SLOTS; t++)
+                if (textures[u][t] == id)
+                    textures[u][t] = 0;
+        glDeleteTextures(1, &id);
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    static const unsigned char UNKNOWN_CAP = 2;
+    static const std::size_t BUFFER_SLOTS = 10;
+    static const std::size_t INDEXED_TARGETS = 2;
+    static const std::size_t INDEXED_SLOTS = 16;
+    static const std::size_t TEXTURE_SLOTS = 5;
+    static const std::size_t CAPABILITY_SLOTS = 12;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint elementBuffer;
+    unsigned int activeUnit;
+    GLuint buffers[BUFFER_SLOTS];
+    GLuint indexedBuffers[INDEXED_TARGETS][INDEXED_SLOTS];
+    GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_SLOTS];
+    unsigned char capabilities[CAPABILITY_SLOTS];
+
+    FrameStats current;
+    FrameStats previous;
+
+    GLStateCache() { invalidate(); }
+    GLStateCache(const GLStateCache&) = delete;
+    GLStateCache& operator=(const GLStateCache&) = delete;
+
+    // map a target/cap to its shadow slot, nullptr for anything we don't track (those calls are always issued)
+    GLuint* bufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ELEMENT_ARRAY_BUFFER: return vertexArray == UNKNOWN ? nullptr : &elementBuffer;
+        case GL_ARRAY_BUFFER:         return &buffers[0];
+        case GL_UNIFORM_BUFFER:       return &buffers[1];
+        case GL_COPY_READ_BUFFER:     return &buffers[2];
+        case GL_COPY_WRITE_BUFFER:    return &buffers[3];
+        case GL_PIXEL_PACK_BUFFER:    return &buffers[4];
+        case GL_PIXEL_UNPACK_BUFFER:  return &buffers[5];
+        case GL_TEXTURE_BUFFER:       return &buffers[6];
+        case GL_TRANSFORM_FEEDBACK_BUFFER: return &buffers[7];
+        case GL_DRAW_INDIRECT_BUFFER: return &buffers[8];
+        case GL_SHADER_STORAGE_BUFFER: return &buffers[9];
+        default:                      return nullptr;
+        }
+    }
+
+    GLuint* indexedSlot(GLenum target, GLuint index)
+    {
+        if (index >= INDEXED_SLOTS)
+            return nullptr;
+        switch (target)
+        {
+        case GL_UNIFORM_BUFFER:        return &indexedBuffers[0][index];
+        case GL_SHADER_STORAGE_BUFFER: return &indexedBuffers[1][index];
+        default:                       return nullptr;
+        }
+    }
+
+    GLuint* textureSlot(unsigned int unit, GLenum target)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return nullptr;
+        switch (target)
+        {
+        case GL_TEXTURE_2D:       return &textures[unit][0];
+        case GL_TEXTURE_2D_ARRAY: return &textures[unit][1];
+        case GL_TEXTURE_CUBE_MAP: return &textures[unit][2];
+        case GL_TEXTURE_3D:       return &textures[unit][3];
+        case GL_TEXTURE_BUFFER:   return &textures[unit][4];
+        default:                  return nullptr;
+        }
+    }
+
+    unsigned char* capabilitySlot(GLenum cap)
+    {
+        switch (cap)
+        {
+        case GL_DEPTH_TEST:           return &capabilities[0];
+        case GL_CULL_FACE:            return &capabilities[1];
+        case GL_BLEND:                return &capabilities[2];
+        case GL_STENCIL_TEST:         return &capabilities[3];
+        case GL_SCISSOR_TEST:         return &capabilities[4];
+        case GL_POLYGON_OFFSET_FILL:  return &capabilities[5];
+        case GL_POLYGON_OFFSET_LINE:  return &capabilities[6];
+        case GL_MULTISAMPLE:          return &capabilities[7];
+        case GL_FRAMEBUFFER_SRGB:     return &capabilities[8];
+        case GL_RASTERIZER_DISCARD:   return &capabilities[9];
+        case GL_PROGRAM_POINT_SIZE:   return &capabilities[10];
+        case GL_DEPTH_CLAMP:          return &capabilities[11];
+        default:                      return nullptr;
+        }
+    }
+};
+
+// shorthand used throughout the renderer
+inline GLStateCache& glState()
+{
+    return GLStateCache::instance();
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+// GPU time of a fixed set of passes, measured with GL_TIME_ELAPSED queries. Each pass has one query per
+// frame in flight; results are read FRAMES frames later, once available, so measuring never stalls the
+// pipeline. A pass whose old query still hasn't finished is simply not measured that frame.
+class GpuTimer
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    // ------------------------------------------------------------------------
+    void create(unsigned int passCount)
+    {
+        passes = passCount;
+        queries.resize(FRAMES * passes);
+        issued.assign(FRAMES * passes, false);
+        results.assign(passes, 0.0f);
+        glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    // delete the queries, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        if (!queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+        queries.clear();
+        issued.clear();
+    }
+
+    // move to the next frame's queries and collect the results they held
+    // ------------------------------------------------------------------------
+    void beginFrame()
+    {
+        slot = (slot + 1) % FRAMES;
+        for (unsigned int pass = 0; pass < passes; pass++)
+        {
+            unsigned int i = slot * passes + pass;
+            if (!issued[i])
+                continue;
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            results[pass] = static_cast<float>(nanoseconds) * 1e-6f;
+            issued[i] = false;
+        }
+    }
+
+    // time elapsed queries can't nest: one pass at a time
+    // ------------------------------------------------------------------------
+    void begin(unsigned int pass)
+    {
+        active = slot * passes + pass;
+        if (issued[active])
+        {
+            active = NONE;  // last use of this query is still in flight
+            return;
+        }
+        glBeginQuery(GL_TIME_ELAPSED, queries[active]);
+    }
+
+    void end()
+    {
+        if (active == NONE)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[active] = true;
+        active = NONE;
+    }
+
+    // latest measured GPU time of a pass
+    float milliseconds(unsigned int pass) const { return results[pass]; }
+
+private:
+    static const unsigned int NONE = 0xFFFFFFFFu;
+
+    unsigned int passes = 0;
+    unsigned int slot = 0;
+    unsigned int active = NONE;
+    std::vector<GLuint> queries;    // [frame slot][pass]
+    std::vector<bool> issued;       // query holds a result that hasn't been read yet
+    std::vector<float> results;
+};
+#endif
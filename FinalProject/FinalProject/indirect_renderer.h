@@ -0,0 +1,235 @@
+#ifndef INDIRECT_RENDERER_H
+#define INDIRECT_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "mesh.h"
+#include "model.h"
+#include "render_queue.h"
+#include "stream_ring.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// GL 4.6 submission path. The meshes of every registered model are packed into one shared vertex/index
+// buffer, so a run of sorted packets that share a program and material becomes a single
+// glMultiDrawElementsIndirect call. Per-draw MVP matrices and atlas layers live in an SSBO indexed by
+// drawBase + gl_DrawID, so meshes with different materials in the same texture arrays share one call.
+// Commands and DrawData of a frame are written back to back into one StreamRing region.
+//
+// Packets that can't be batched (geometry outside the pool, programs without an indirect variant) are drawn
+// on the classic path in their sorted position, so the 3.3 path remains the fallback for everything.
+class IndirectRenderer
+{
+public:
+    // append the meshes of a model to the geometry pool, call upload() once everything is added
+    // ------------------------------------------------------------------------
+    void addModel(const Model& model)
+    {
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+        {
+            const Mesh& mesh = model.meshes[i];
+            MeshRange range;
+            range.firstIndex = static_cast<GLuint>(indices.size());
+            range.count = static_cast<GLuint>(mesh.indices.size());
+            range.baseVertex = static_cast<GLint>(vertices.size());
+            ranges[&mesh] = range;
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+    }
+
+    // packets drawn with `classic` are batched and drawn with `indirect` instead
+    // ------------------------------------------------------------------------
+    void setProgram(const Shader& classic, Shader& indirect)
+    {
+        programs[&classic] = &indirect;
+    }
+
+    // create the pooled buffers and the command/DrawData ring; the CPU copies are released afterwards
+    // ------------------------------------------------------------------------
+    void upload()
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glState().bindVertexArray(VAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        Mesh::setVertexAttributes();
+        glState().bindVertexArray(0);
+
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+
+        GLint alignment = 256;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        drawDataAlignment = alignment;
+        stream.create(4096);
+    }
+
+    // draw a sorted queue, batching what the pool can batch
+    // ------------------------------------------------------------------------
+    void execute(const RenderQueue& queue)
+    {
+        buildBatches(queue);
+        drawCalls = 0;
+        GLintptr commandBase = 0;
+        if (!commands.empty())
+        {
+            // [commands][padding][DrawData...], the DrawData start honours the SSBO offset alignment
+            GLsizeiptr commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+            GLsizeiptr dataOffset = StreamRing::align(commandBytes, drawDataAlignment);
+            GLsizeiptr dataBytes = drawData.size() * sizeof(DrawData);
+            unsigned char* out = stream.begin(dataOffset + dataBytes);
+            std::memcpy(out, commands.data(), commandBytes);
+            std::memcpy(out + dataOffset, drawData.data(), dataBytes);
+            commandBase = stream.end();
+
+            glState().bindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.id());
+            glState().bindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, stream.id(), commandBase + dataOffset, dataBytes);
+        }
+
+        static const Uniform<int> drawBase("drawBase");
+        for (std::size_t i = 0; i < batches.size(); i++)
+        {
+            const Batch& batch = batches[i];
+            if (batch.packet != nullptr)
+            {
+                queue.draw(*batch.packet);
+                drawCalls++;
+                continue;
+            }
+            glState().useProgram(batch.shader->ID);
+            batch.shader->set(drawBase, static_cast<int>(batch.first));
+            if (batch.material->material.diffuseArray != 0)
+                batch.material->bindMaterialArrays();
+            else
+                batch.material->bindTextures(*batch.shader);
+            glState().bindVertexArray(VAO);
+            glExt().MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                (void*)(commandBase + batch.first * sizeof(DrawElementsIndirectCommand)), batch.count, 0);
+            drawCalls++;
+        }
+    }
+
+    // delete the GL objects, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        if (VAO == 0)
+            return;
+        glState().deleteVertexArray(VAO);
+        glState().deleteBuffer(VBO);
+        glState().deleteBuffer(EBO);
+        stream.release();
+        VAO = VBO = EBO = 0;
+    }
+
+    // number of draw calls (multi-draws count once) issued by the last execute()
+    unsigned int lastDrawCalls() const { return drawCalls; }
+
+private:
+    static const GLuint DRAW_DATA_BINDING = 0;
+
+    // std430 layout of one DrawData entry in model_loading_indirect_vertex_shader.glsl
+    struct DrawData {
+        glm::mat4 modelViewProjection;  // the same matrix the depth prepass reads from ObjectData
+        glm::ivec4 material;    // x = diffuse layer, y = specular layer
+    };
+
+    struct MeshRange {
+        GLuint firstIndex;
+        GLuint count;
+        GLint baseVertex;
+    };
+
+    // either one multi-draw over commands[first, first + count) or a single classic packet
+    struct Batch {
+        Shader* shader;
+        const Mesh* material;       // mesh whose textures the whole batch shares
+        GLint first;
+        GLsizei count;
+        const DrawPacket* packet;   // non-null: draw this packet on the classic path
+    };
+
+    std::unordered_map<const Mesh*, MeshRange> ranges;
+    std::unordered_map<const Shader*, Shader*> programs;   // keyed by object: the pipeline swaps program IDs
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData> drawData;
+    std::vector<Batch> batches;
+    unsigned int drawCalls = 0;
+
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    StreamRing stream;
+    GLsizeiptr drawDataAlignment = 256;
+
+    // meshes batch together when they share a program and the same texture arrays (or the same set of textures)
+    static bool sameMaterial(const Mesh& a, const Mesh& b)
+    {
+        if (a.material.diffuseArray != 0 || b.material.diffuseArray != 0)
+            return a.material.diffuseArray == b.material.diffuseArray && a.material.specularArray == b.material.specularArray;
+        if (a.textures.size() != b.textures.size())
+            return false;
+        for (std::size_t i = 0; i < a.textures.size(); i++)
+            if (a.textures[i].id != b.textures[i].id)
+                return false;
+        return true;
+    }
+
+    void buildBatches(const RenderQueue& queue)
+    {
+        commands.clear();
+        drawData.clear();
+        batches.clear();
+        for (std::size_t i = 0; i < queue.size(); i++)
+        {
+            const DrawPacket& packet = queue.sorted(i);
+            std::unordered_map<const Mesh*, MeshRange>::const_iterator range = ranges.end();
+            std::unordered_map<const Shader*, Shader*>::const_iterator program = programs.find(packet.shader);
+            if (packet.mesh != nullptr && program != programs.end())
+                range = ranges.find(packet.mesh);
+            if (range == ranges.end())
+            {
+                Batch classic = { nullptr, nullptr, 0, 0, &packet };
+                batches.push_back(classic);
+                continue;
+            }
+
+            DrawElementsIndirectCommand command;
+            command.count = range->second.count;
+            command.instanceCount = 1;
+            command.firstIndex = range->second.firstIndex;
+            command.baseVertex = range->second.baseVertex;
+            command.baseInstance = 0;
+
+            bool extend = !batches.empty() && batches.back().packet == nullptr &&
+                batches.back().shader == program->second && sameMaterial(*batches.back().material, *packet.mesh);
+            if (extend)
+                batches.back().count++;
+            else
+            {
+                Batch batch = { program->second, packet.mesh, static_cast<GLint>(commands.size()), 1, nullptr };
+                batches.push_back(batch);
+            }
+            commands.push_back(command);
+            DrawData data;
+            data.modelViewProjection = queue.objectMatrices(packet).modelViewProjection;
+            data.material = glm::ivec4(packet.mesh->material.diffuseLayer, packet.mesh->material.specularLayer, 0, 0);
+            drawData.push_back(data);
+        }
+    }
+};
+#endif
@@ -0,0 +1,304 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "uniform_blocks.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <emmintrin.h>
+
+// texture units of the clustered light buffers, kept clear of the material units
+#define CLUSTER_CELL_UNIT 4
+#define CLUSTER_INDEX_UNIT 5
+#define CLUSTER_LIGHT_UNIT 6
+
+// a point light with a finite range, as used by clustered shading
+struct PointLight {
+    glm::vec3 position = glm::vec3(0.0f);  // world space
+    float radius = 1.0f;                    // the light contributes nothing beyond this distance
+    glm::vec3 color = glm::vec3(1.0f);
+};
+
+// Clustered forward lighting. The view frustum is cut into GRID_X x GRID_Y screen tiles and GRID_Z slices that
+// grow exponentially with depth; every frame each cluster gets the list of lights whose sphere touches its
+// view-space bounding box, and the shader only loops over the list of the cluster its fragment falls in.
+//
+// Assignment runs on the worker pool, one job per depth slice: a job first keeps the lights overlapping its
+// slice, then tests them four at a time (SSE sphere-vs-AABB) against the boxes of the slice's tiles. The slice
+// lists are concatenated in order, so the result doesn't depend on the thread count.
+//
+// GLSL 330 has no storage buffers, so the result goes to the shader through three texture buffers:
+//     clusterCells    RG32UI   (first index, light count) per cluster
+//     clusterIndices  R16UI    light indices, cluster after cluster
+//     clusterLights   RGBA32F  two texels per light: view space position and radius, color
+// and the grid parameters through the ClusterData uniform block.
+class LightClusterer
+{
+public:
+    enum {
+        GRID_X = 16,
+        GRID_Y = 9,
+        GRID_Z = 24,
+        TILES = GRID_X * GRID_Y,
+        CLUSTER_COUNT = TILES * GRID_Z,
+        MAX_LIGHTS = 65535              // light indices are 16 bit
+    };
+
+    struct Stats {
+        unsigned int lights = 0;        // lights assigned this frame
+        unsigned int indices = 0;       // entries in all cluster lists
+        unsigned int busiest = 0;       // longest single cluster list
+    };
+
+    explicit LightClusterer(WorkerPool& pool) : pool(pool), slices(GRID_Z) {}
+
+    // create the buffers and their texture views, bound once to their units
+    // ------------------------------------------------------------------------
+    void create()
+    {
+        block.reset(new UniformBlock<ClusterUniforms>(CLUSTER_UBO_BINDING));
+        const GLenum formats[BUFFER_COUNT] = { GL_RG32UI, GL_R16UI, GL_RGBA32F };
+        glGenBuffers(BUFFER_COUNT, buffers);
+        glGenTextures(BUFFER_COUNT, textures);
+        for (int i = 0; i < BUFFER_COUNT; i++)
+        {
+            glState().bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glState().bindTexture(CLUSTER_CELL_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+        }
+    }
+
+    // delete the buffers, textures and block, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (int i = 0; i < BUFFER_COUNT; i++)
+        {
+            glState().deleteTexture(textures[i]);
+            glState().deleteBuffer(buffers[i]);
+            textures[i] = buffers[i] = 0;
+        }
+        if (block)
+            block->release();
+        block.reset();
+    }
+
+    // assign the lights to the clusters of this camera and upload the result
+    // ------------------------------------------------------------------------
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, float fovY, float aspect,
+                float nearPlane, float farPlane, int width, int height)
+    {
+        if (fovY != this->fovY || aspect != this->aspect || nearPlane != this->nearPlane || farPlane != this->farPlane)
+        {
+            this->fovY = fovY;
+            this->aspect = aspect;
+            this->nearPlane = nearPlane;
+            this->farPlane = farPlane;
+            buildClusterBounds();
+        }
+
+        lightCount = static_cast<unsigned int>(std::min<std::size_t>(lights.size(), MAX_LIGHTS));
+        viewLights.resize(lightCount);
+        lightTexels.resize(2 * lightCount);
+        pool.parallelFor((lightCount + LIGHT_RANGE - 1) / LIGHT_RANGE, [&](unsigned int range) {
+            unsigned int end = (range + 1) * LIGHT_RANGE < lightCount ? (range + 1) * LIGHT_RANGE : lightCount;
+            for (unsigned int i = range * LIGHT_RANGE; i < end; i++)
+            {
+                glm::vec3 position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+                viewLights[i] = glm::vec4(position, lights[i].radius);
+                lightTexels[2 * i] = viewLights[i];
+                lightTexels[2 * i + 1] = glm::vec4(lights[i].color, 0.0f);
+            }
+        });
+        pool.parallelFor(GRID_Z, [&](unsigned int slice) { assignSlice(slice); });
+
+        // concatenate the slice lists; each cluster records where its run starts
+        cells.resize(2 * CLUSTER_COUNT);
+        indices.clear();
+        current = Stats();
+        current.lights = lightCount;
+        for (unsigned int z = 0; z < GRID_Z; z++)
+        {
+            const Slice& slice = slices[z];
+            uint32_t first = static_cast<uint32_t>(indices.size());
+            for (unsigned int t = 0; t < TILES; t++)
+            {
+                cells[2 * (z * TILES + t)] = first;
+                cells[2 * (z * TILES + t) + 1] = slice.counts[t];
+                first += slice.counts[t];
+                if (slice.counts[t] > current.busiest)
+                    current.busiest = slice.counts[t];
+            }
+            indices.insert(indices.end(), slice.indices.begin(), slice.indices.end());
+        }
+        current.indices = static_cast<unsigned int>(indices.size());
+
+        upload(CELL_BUFFER, cells.data(), cells.size() * sizeof(uint32_t));
+        upload(INDEX_BUFFER, indices.data(), indices.size() * sizeof(uint16_t));
+        upload(LIGHT_BUFFER, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        for (int i = 0; i < BUFFER_COUNT; i++)
+            glState().bindTexture(CLUSTER_CELL_UNIT + i, GL_TEXTURE_BUFFER, textures[i]);
+
+        float logRatio = std::log(farPlane / nearPlane);
+        block->data.screen = glm::vec4(float(width), float(height), float(GRID_X) / float(width), float(GRID_Y) / float(height));
+        block->data.slicing = glm::vec4(GRID_Z / logRatio, -GRID_Z * std::log(nearPlane) / logRatio, nearPlane, farPlane);
+        block->data.grid = glm::ivec4(GRID_X, GRID_Y, GRID_Z, static_cast<int>(lightCount));
+        block->upload();
+    }
+
+    Stats stats() const { return current; }
+
+private:
+    enum { CELL_BUFFER, INDEX_BUFFER, LIGHT_BUFFER, BUFFER_COUNT };
+    enum { LIGHT_RANGE = 256 };         // lights per transform job
+
+    // one job's output: the lights of every tile of one depth slice
+    struct Slice {
+        std::vector<float> x, y, z, radius;    // candidates overlapping the slice, structure of arrays for SSE
+        std::vector<uint16_t> ids;
+        std::vector<uint16_t> indices;
+        uint32_t counts[TILES];
+    };
+
+    WorkerPool& pool;
+    std::unique_ptr<UniformBlock<ClusterUniforms> > block;
+    GLuint buffers[BUFFER_COUNT] = { 0, 0, 0 };
+    GLuint textures[BUFFER_COUNT] = { 0, 0, 0 };
+
+    float fovY = 0.0f, aspect = 0.0f, nearPlane = 0.0f, farPlane = 0.0f;
+    std::vector<glm::vec3> boundsMin;   // view space box of every cluster
+    std::vector<glm::vec3> boundsMax;
+
+    unsigned int lightCount = 0;
+    std::vector<glm::vec4> viewLights;  // view space position, radius
+    std::vector<glm::vec4> lightTexels;
+    std::vector<Slice> slices;
+    std::vector<uint32_t> cells;
+    std::vector<uint16_t> indices;
+    Stats current;
+
+    // view depth where slice z begins
+    float sliceDepth(unsigned int z) const
+    {
+        return nearPlane * std::pow(farPlane / nearPlane, float(z) / float(GRID_Z));
+    }
+
+    void buildClusterBounds()
+    {
+        boundsMin.resize(CLUSTER_COUNT);
+        boundsMax.resize(CLUSTER_COUNT);
+        float tanY = std::tan(fovY * 0.5f);
+        float tanX = tanY * aspect;
+        for (unsigned int z = 0; z < GRID_Z; z++)
+        {
+            float depthNear = sliceDepth(z), depthFar = sliceDepth(z + 1);
+            for (unsigned int y = 0; y < GRID_Y; y++)
+            {
+                float y0 = -1.0f + 2.0f * y / GRID_Y, y1 = -1.0f + 2.0f * (y + 1) / GRID_Y;
+                for (unsigned int x = 0; x < GRID_X; x++)
+                {
+                    float x0 = -1.0f + 2.0f * x / GRID_X, x1 = -1.0f + 2.0f * (x + 1) / GRID_X;
+                    // the tile's frustum section is widest at one of its two depth planes
+                    float xs[4] = { x0 * tanX * depthNear, x0 * tanX * depthFar, x1 * tanX * depthNear, x1 * tanX * depthFar };
+                    float ys[4] = { y0 * tanY * depthNear, y0 * tanY * depthFar, y1 * tanY * depthNear, y1 * tanY * depthFar };
+                    glm::vec3 minimum(xs[0], ys[0], -depthFar), maximum(xs[0], ys[0], -depthNear);
+                    for (int i = 1; i < 4; i++)
+                    {
+                        minimum.x = glm::min(minimum.x, xs[i]);
+                        maximum.x = glm::max(maximum.x, xs[i]);
+                        minimum.y = glm::min(minimum.y, ys[i]);
+                        maximum.y = glm::max(maximum.y, ys[i]);
+                    }
+                    boundsMin[z * TILES + y * GRID_X + x] = minimum;
+                    boundsMax[z * TILES + y * GRID_X + x] = maximum;
+                }
+            }
+        }
+    }
+
+    void assignSlice(unsigned int z)
+    {
+        Slice& slice = slices[z];
+        slice.x.clear();
+        slice.y.clear();
+        slice.z.clear();
+        slice.radius.clear();
+        slice.ids.clear();
+        slice.indices.clear();
+
+        // lights reaching into the slice's depth range
+        float depthNear = sliceDepth(z), depthFar = sliceDepth(z + 1);
+        for (unsigned int i = 0; i < lightCount; i++)
+        {
+            const glm::vec4& light = viewLights[i];
+            float depth = -light.z;
+            if (depth + light.w < depthNear || depth - light.w > depthFar)
+                continue;
+            slice.x.push_back(light.x);
+            slice.y.push_back(light.y);
+            slice.z.push_back(light.z);
+            slice.radius.push_back(light.w);
+            slice.ids.push_back(static_cast<uint16_t>(i));
+        }
+        // pad to whole SSE groups with lights that can't touch anything
+        std::size_t candidates = slice.ids.size();
+        while (slice.x.size() % 4 != 0)
+        {
+            slice.x.push_back(1e18f);
+            slice.y.push_back(1e18f);
+            slice.z.push_back(1e18f);
+            slice.radius.push_back(0.0f);
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        for (unsigned int t = 0; t < TILES; t++)
+        {
+            const glm::vec3& minimum = boundsMin[z * TILES + t];
+            const glm::vec3& maximum = boundsMax[z * TILES + t];
+            __m128 minX = _mm_set1_ps(minimum.x), minY = _mm_set1_ps(minimum.y), minZ = _mm_set1_ps(minimum.z);
+            __m128 maxX = _mm_set1_ps(maximum.x), maxY = _mm_set1_ps(maximum.y), maxZ = _mm_set1_ps(maximum.z);
+            std::size_t first = slice.indices.size();
+            for (std::size_t i = 0; i < candidates; i += 4)
+            {
+                // squared distance from the sphere center to the box, 0 inside
+                __m128 cx = _mm_loadu_ps(&slice.x[i]);
+                __m128 cy = _mm_loadu_ps(&slice.y[i]);
+                __m128 cz = _mm_loadu_ps(&slice.z[i]);
+                __m128 r = _mm_loadu_ps(&slice.radius[i]);
+                __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, cx), _mm_sub_ps(cx, maxX)), zero);
+                __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minY, cy), _mm_sub_ps(cy, maxY)), zero);
+                __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minZ, cz), _mm_sub_ps(cz, maxZ)), zero);
+                __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                int hits = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_mul_ps(r, r)));
+                for (int lane = 0; hits != 0; lane++, hits >>= 1)
+                    if (hits & 1)
+                        slice.indices.push_back(slice.ids[i + lane]);
+            }
+            slice.counts[t] = static_cast<uint32_t>(slice.indices.size() - first);
+        }
+    }
+
+    // orphan and refill one texture buffer; never empty, a zero sized buffer can't back a texture
+    void upload(int buffer, const void* data, std::size_t size)
+    {
+        glState().bindBuffer(GL_TEXTURE_BUFFER, buffers[buffer]);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(size > 16 ? size : 16), nullptr, GL_STREAM_DRAW);
+        if (size > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, static_cast<GLsizeiptr>(size), data);
+    }
+
+    LightClusterer(const LightClusterer&) = delete;
+    LightClusterer& operator=(const LightClusterer&) = delete;
+};
+#endif
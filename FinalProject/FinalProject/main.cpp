@@ -5,25 +5,73 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "shader_m.h"
+#include "shader.h"
 #include "camera.h"
 #include "model.h"
-#include "sphere.h"
+#include "geometry_registry.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "indirect_renderer.h"
+#include "program_pipeline.h"
+#include "shader_variants.h"
+#include "material_atlas.h"
+#include "uniform_blocks.h"
+#include "worker_pool.h"
+#include "occlusion_culler.h"
+#include "occlusion_queries.h"
+#include "gpu_timer.h"
+#include "draw_list_builder.h"
+#include "light_clusters.h"
+#include "deferred_renderer.h"
+#include "shadow_maps.h"
+#include "procedural_sphere.h"
+#include "sphere_impostors.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include <iostream>
+#include <sstream>
+#include <memory>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void updateWindowTitle(GLFWwindow* window, float currentFrame, const OcclusionCuller& culler, const OcclusionQueries& queries,
+                       const GpuTimer& timer, const LightClusterer& clusters, const ShadowMapper& shadows);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+const bool PREFER_GL46 = true; // try a 4.6 context for the multi-draw indirect path, fall back to 3.3
 bool lightOn = true;
+bool occlusionCullingOn = true;
+bool occlusionQueriesOn = true;
+bool depthPrepassOn = true;
+bool clusteredLightsOn = true;
+bool deferredShadingOn = false;
+bool shadowsOn = true;
+bool lightMarkersOn = true;
+bool impostorsOn = true;
+bool wireframeOn = false;
+const unsigned int CLUSTERED_LIGHT_COUNT = 1024;
+const glm::vec3 SUN_DIRECTION(-0.4f, 1.0f, 0.3f);  // towards the sun, world space
+const glm::vec3 SUN_COLOR(0.5f, 0.48f, 0.42f);
+const float LIGHT_MARKER_SCALE = 0.03f;    // marker sphere radius per unit of light radius
+const unsigned int IMPOSTOR_SPHERE_COUNT = 250000;
+
+// GPU timed passes
+enum TimedPass {
+    TIMER_DEPTH_PREPASS = 0,
+    TIMER_COLOR_PASS = 1,       // the G-buffer pass when shading is deferred
+    TIMER_LIGHTING_PASS = 2,    // deferred only
+    TIMER_SHADOW_PASS = 3,
+    TIMER_PASS_COUNT
+};
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -40,8 +88,6 @@ int main()
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     #ifdef __APPLE__
@@ -50,7 +96,20 @@ int main()
 
     // glfw window creation
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Real-Time Rasterizer", NULL, NULL);
+    // a 4.6 context enables multi-draw indirect submission; 3.3 stays the baseline if it can't be created
+    GLFWwindow* window = NULL;
+    if (PREFER_GL46)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Real-Time Rasterizer", NULL, NULL);
+    }
+    if (window == NULL)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Real-Time Rasterizer", NULL, NULL);
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -72,25 +131,90 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    // entry points beyond 3.3 that glad wasn't generated for
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     stbi_set_flip_vertically_on_load(true);
 
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
-
-    // build and compile our shader programs
-    Shader phongShader("vertex_shader.glsl", "fragment_shader.glsl");
-    Shader modelShader("model_loading_vertex_shader.glsl", "model_loading_fragment_shader.glsl");
+    glState().enable(GL_DEPTH_TEST);
+
+    // build and compile our shader programs: all of them are issued at once and compile in the background,
+    // objects draw with the flat fallback program until theirs is ready
+    ProgramPipeline programPipeline;
+    programPipeline.create("depth_prepass_vertex_shader.glsl", "fallback_fragment_shader.glsl", [](Shader& shader) {
+        bindUniformBlocks(shader.ID);
+    });
+    Shader modelShader(programPipeline.fallbackProgram());
+    Shader depthShader(programPipeline.fallbackProgram());
+    Shader ditheredDepthShader(programPipeline.fallbackProgram());
 
     // load models
     // -----------
 	Model cyborgModelReference("cyborg/cyborg.obj");
     Model rockModelReference("rock/rock.obj");
 
-    // load sphere
-	Sphere sphere(1.0f, 36, 18);
+    // move the model textures into texture arrays so meshes with different materials can share binds
+    MaterialAtlas materialAtlas;
+    materialAtlas.addModel(cyborgModelReference);
+    materialAtlas.addModel(rockModelReference);
+    materialAtlas.build();
+
+    // camera and light data come from uniform blocks at fixed binding points
+    UniformBlock<FrameUniforms> frameBlock(FRAME_UBO_BINDING);
+    UniformBlock<LightUniforms> lightBlock(LIGHT_UBO_BINDING);
+    // setup runs on every program swapped in, so reloaded programs get the same bindings
+    ProgramPipeline::SetupFunction blockSetup = [](Shader& shader) {
+        bindUniformBlocks(shader.ID);
+    };
+    ProgramPipeline::SetupFunction phongSetup = [](Shader& shader) {
+        bindUniformBlocks(shader.ID);
+        shader.use();
+        shader.setInt("clusterCells", CLUSTER_CELL_UNIT);
+        shader.setInt("clusterIndices", CLUSTER_INDEX_UNIT);
+        shader.setInt("clusterLights", CLUSTER_LIGHT_UNIT);
+        shader.setInt("shadowMap", SHADOW_MAP_UNIT);
+    };
+    ProgramPipeline::SetupFunction materialSetup = [](Shader& shader) {
+        bindUniformBlocks(shader.ID);
+        shader.use();
+        shader.setInt("materialDiffuse", MATERIAL_DIFFUSE_UNIT);
+        shader.setInt("materialSpecular", MATERIAL_SPECULAR_UNIT);
+    };
+    // the phong shader comes in permutations by light count and features, picked per draw
+    ShaderVariants phongVariants;
+    phongVariants.create(programPipeline, "vertex_shader.glsl", "fragment_shader.glsl", phongSetup);
+    programPipeline.request(modelShader, "model_loading_vertex_shader.glsl", "model_loading_fragment_shader.glsl", materialSetup);
+    programPipeline.request(depthShader, "depth_prepass_vertex_shader.glsl", "depth_prepass_fragment_shader.glsl", blockSetup);
+    programPipeline.request(ditheredDepthShader, "depth_prepass_vertex_shader.glsl", "depth_prepass_dithered_fragment_shader.glsl",
+                            blockSetup);
+    // G-buffer programs of the deferred path
+    Shader gbufferShader(programPipeline.fallbackProgram());
+    Shader gbufferModelShader(programPipeline.fallbackProgram());
+    programPipeline.request(gbufferShader, "vertex_shader.glsl", "gbuffer_fragment_shader.glsl", blockSetup);
+    programPipeline.request(gbufferModelShader, "gbuffer_model_vertex_shader.glsl", "gbuffer_model_fragment_shader.glsl", materialSetup);
+    // per-object constants travel with each draw packet (ObjectData), the phong objects share one color
+    const glm::vec4 objectColor(1.0f, 0.5f, 0.31f, 1.0f);
+
+    // procedural meshes: one unit sphere per parameter set, shared by every sphere in the scene
+    GeometryRegistry geometryRegistry;
+    const SharedGeometry& sphereGeometry = geometryRegistry.sphere(36, 18);
+    // tessellation by screen size: evenly spread icosphere levels, crossfaded over the last quarter before each switch
+    GeometryLod sphereLod = geometryRegistry.sphereLod(true);
+    sphereLod.fadeBand = 0.25f;
+    // debug view of the sphere's triangles: the sphere's own VAO, surface and edges drawn in one pass
+    Sphere wireframeSphere(1.0f, 36, 18);
+    wireframeSphere.createBuffers();
+    Shader wireframeShader(programPipeline.fallbackProgram());
+    ProgramPipeline::SetupFunction wireframeSetup = [](Shader& shader) {
+        bindUniformBlocks(shader.ID);
+        shader.use();
+        shader.setVec4("lineColor", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+        shader.setFloat("lineWidth", 1.5f);
+    };
+    programPipeline.request(wireframeShader, "wireframe_vertex_shader.glsl", "wireframe_fragment_shader.glsl", wireframeSetup);
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -142,10 +266,10 @@ int main()
     glGenVertexArrays(1, &cubeVAO);
     glGenBuffers(1, &cubeVBO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glBindVertexArray(cubeVAO);
+    glState().bindVertexArray(cubeVAO);
 
     // position attribute
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
@@ -157,49 +281,134 @@ int main()
     // second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
     unsigned int lightCubeVAO;
     glGenVertexArrays(1, &lightCubeVAO);
-    glBindVertexArray(lightCubeVAO);
+    glState().bindVertexArray(lightCubeVAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glState().bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
     // note that we update the lamp's position attribute's stride to reflect the updated buffer data
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    // configure sphere VAO, VBO, IBO
-    // create VAO to store all vertex array state to VAO
-    GLuint sphereVAO;
-    glGenVertexArrays(1, &sphereVAO);
-    glBindVertexArray(sphereVAO);
-
-    // create VBO to copy interleaved vertex data (V/N/T) to VBO
-    GLuint sphereVBO;
-    glGenBuffers(1, &sphereVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);           // for vertex data
-    glBufferData(GL_ARRAY_BUFFER,                   // target
-        sphere.getInterleavedVertexSize(), // data size, # of bytes
-        sphere.getInterleavedVertices(),   // ptr to vertex data
-        GL_STATIC_DRAW);
-
-    // create VBO to copy index data to VBO
-    GLuint sphereIBO;
-    glGenBuffers(1, &sphereIBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereIBO);   // for index data
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,           // target
-        sphere.getIndexSize(),             // data size, # of bytes
-        sphere.getIndices(),               // ptr to index data
-        GL_STATIC_DRAW);
-
-    // activate attrib arrays
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
+    glState().bindVertexArray(0);
+
+    RenderQueue renderQueue;
+
+    // the two models hide whatever is behind them; bounds are tested against them on the CPU before submission
+    WorkerPool workers;
+    OcclusionCuller occlusionCuller(workers);
+    unsigned int rockOccluder = occlusionCuller.addOccluder(rockModelReference);
+    unsigned int cyborgOccluder = occlusionCuller.addOccluder(cyborgModelReference);
+
+    // the scene; transforms, culling and draw packets are computed by jobs on the workers every frame
+    enum SceneIndex { SCENE_ROCK = 0, SCENE_CYBORG, SCENE_SPHERE, SCENE_CUBE, SCENE_COUNT };
+    std::vector<SceneObject> scene(SCENE_COUNT);
+
+    SceneObject& rock = scene[SCENE_ROCK];
+    rock.model = &rockModelReference;
+    rock.shader = &modelShader;
+    rock.deferredShader = &gbufferModelShader;
+    rock.position = glm::vec3(2.0f, 0.0f, 0.0f);
+    rock.scale = glm::vec3(0.5f, 0.5f, 0.5f);	// it's a bit too big for our scene, so scale it down
+
+    SceneObject& cyborg = scene[SCENE_CYBORG];
+    cyborg.model = &cyborgModelReference;
+    cyborg.shader = &modelShader;
+    cyborg.deferredShader = &gbufferModelShader;
+    cyborg.position = glm::vec3(-2.0f, 0.0f, 0.0f);
+    cyborg.scale = glm::vec3(0.5f, 0.5f, 0.5f);
+
+    SceneObject& sphereObject = scene[SCENE_SPHERE];
+    sphereObject.variants = &phongVariants;
+    sphereObject.features = PERMUTATION_SPECULAR | PERMUTATION_LOD_FADE;
+    sphereObject.deferredShader = &gbufferShader;
+    sphereObject.vao = sphereGeometry.vao;
+    sphereObject.count = sphereGeometry.count;
+    sphereObject.indexType = GL_UNSIGNED_INT;
+    sphereObject.boundsMin = sphereGeometry.boundsMin;
+    sphereObject.boundsMax = sphereGeometry.boundsMax;
+    sphereObject.lod = &sphereLod;
+    sphereObject.color = objectColor;
+    sphereObject.position = glm::vec3(0.0f, 1.5f, 0.0f);
+    sphereObject.scale = glm::vec3(0.5f);
+
+    // rotating cube
+    SceneObject& cube = scene[SCENE_CUBE];
+    cube.variants = &phongVariants;
+    cube.features = PERMUTATION_SPECULAR;
+    cube.deferredShader = &gbufferShader;
+    cube.vao = cubeVAO;
+    cube.count = 36;
+    cube.color = objectColor;
+    cube.rotationAxis = glm::vec3(0.5f, 1.0f, 0.0f);
+    cube.rotationSpeed = 1.0f;
+    cube.shadow = SHADOW_DYNAMIC;
+
+    DrawListBuilder drawListBuilder(workers);
+
+    // a field of small colored point lights bobbing over the scene, assigned to view clusters on the workers
+    LightClusterer lightClusterer(workers);
+    lightClusterer.create();
+    std::vector<PointLight> clusteredLights(CLUSTERED_LIGHT_COUNT);
+    std::vector<glm::vec3> lightAnchors(CLUSTERED_LIGHT_COUNT);
+    for (unsigned int i = 0; i < CLUSTERED_LIGHT_COUNT; i++)
+    {
+        float u = float(i % 32) / 31.0f, v = float(i / 32) / 31.0f;
+        lightAnchors[i] = glm::vec3(-8.0f + 16.0f * u, 0.0f, -8.0f + 16.0f * v);
+        float hue = std::fmod(i * 0.618034f, 1.0f);
+        clusteredLights[i].color = 0.6f * (0.5f + 0.5f * glm::cos(6.2831853f * (hue + glm::vec3(0.0f, 0.33f, 0.67f))));
+        clusteredLights[i].radius = 1.5f;
+    }
+    // each clustered light is shown as a small sphere, drawn straight from the cluster light buffer
+    ProceduralSphere lightMarkers;
+    lightMarkers.create(CLUSTER_LIGHT_UNIT);
+
+    // a ring of small ray-cast spheres circling above the scene, 20 bytes each
+    SphereImpostors impostors;
+    impostors.create();
+    {
+        std::vector<SphereImpostors::Instance> cloud(IMPOSTOR_SPHERE_COUNT);
+        std::mt19937 random(387);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (unsigned int i = 0; i < IMPOSTOR_SPHERE_COUNT; i++)
+        {
+            float turn = unit(random);
+            float ring = 6.0f + 2.0f * unit(random);
+            float angle = 6.2831853f * turn;
+            cloud[i].center = glm::vec3(ring * std::cos(angle), 3.0f + 0.8f * (unit(random) - 0.5f), ring * std::sin(angle));
+            cloud[i].radius = 0.01f + 0.03f * unit(random);
+            cloud[i].color = SphereImpostors::packColor(0.5f + 0.5f * glm::cos(6.2831853f * (turn + glm::vec3(0.0f, 0.33f, 0.67f))));
+        }
+        impostors.upload(cloud);
+    }
 
-    // set attrib arrays with stride and offset
-    int stride = sphere.getInterleavedStride();     // should be 32 bytes
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, stride, (void*)0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, false, stride, (void*)(sizeof(float) * 3));
-    glVertexAttribPointer(2, 2, GL_FLOAT, false, stride, (void*)(sizeof(float) * 6));
+    // what survives the CPU test is checked again on the GPU, against the full-resolution depth buffer
+    OcclusionQueries occlusionQueries;
+    occlusionQueries.create();
 
-    glBindVertexArray(0);
+    // the sun's cascaded shadow maps; the static casters are cached in the distant cascades
+    ShadowMapper shadowMapper;
+    shadowMapper.create();
+
+    // deferred shading, switched to at runtime in place of the forward color pass
+    DeferredRenderer deferredRenderer;
+    deferredRenderer.create();
+
+    GpuTimer passTimer;
+    passTimer.create(TIMER_PASS_COUNT);
+
+    // on 4.6 the models are pooled and drawn with multi-draw indirect, everything else keeps the classic path
+    std::unique_ptr<IndirectRenderer> indirectRenderer;
+    std::unique_ptr<Shader> modelShaderIndirect;
+    if (glExt().hasMultiDrawIndirect)
+    {
+        modelShaderIndirect.reset(new Shader(programPipeline.fallbackProgram()));
+        programPipeline.request(*modelShaderIndirect, "model_loading_indirect_vertex_shader.glsl",
+                                "model_loading_fragment_shader.glsl", materialSetup);
+        indirectRenderer.reset(new IndirectRenderer());
+        indirectRenderer->addModel(rockModelReference);
+        indirectRenderer->addModel(cyborgModelReference);
+        indirectRenderer->setProgram(modelShader, *modelShaderIndirect);
+        indirectRenderer->upload();
+    }
 
     // render loop
     while (!glfwWindowShouldClose(window))
@@ -209,6 +418,13 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // roll the GL state cache counters over to a new frame
+        glState().beginFrame();
+        // swap in finished programs and start rebuilding edited ones, never waiting on the compiler
+        programPipeline.poll(currentFrame);
+        passTimer.beginFrame();
+        updateWindowTitle(window, currentFrame, occlusionCuller, occlusionQueries, passTimer, lightClusterer, shadowMapper);
+
         processInput(window);
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -216,75 +432,161 @@ int main()
 
         // transformations
         glm::mat4 view = camera.GetViewMatrix(); // moveable camera view (not fixed view)
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-
-        // activate model shader
-        modelShader.use();
-
-        // render the loaded models
-        modelShader.setMat4("view", view);
-        modelShader.setMat4("projection", projection);
-
-        // rock
-        glm::mat4 rockModel = glm::mat4(1.0f);
-        rockModel = glm::translate(rockModel, glm::vec3(2.0f, 0.0f, 0.0f)); // translate it down so it's at the center of the scene
-        rockModel = glm::scale(rockModel, glm::vec3(0.5f, 0.5f, 0.5f));	// it's a bit too big for our scene, so scale it down
-        modelShader.setMat4("model", rockModel);
-        rockModelReference.Draw(modelShader);
-
-        // cyborg
-        glm::mat4 cyborgModel = glm::mat4(1.0f);
-        cyborgModel = glm::translate(cyborgModel, glm::vec3(-2.0f, 0.0f, 0.0f)); 
-        cyborgModel = glm::scale(cyborgModel, glm::vec3(0.5f, 0.5f, 0.5f));	
-        modelShader.setMat4("model", cyborgModel);
-        cyborgModelReference.Draw(modelShader);
-
-        // activate phong shader
-        phongShader.use();
-        phongShader.setVec3("lightPos", glm::vec3(1.2f, 1.0f, 2.0f));
-
-        // first light on or off
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE);
+
+        // per-frame data shared by every program: one upload per block, whatever the number of programs
+        frameBlock.data.view = view;
+        frameBlock.data.projection = projection;
+        frameBlock.data.viewProjection = projection * view;
+        frameBlock.data.cameraPosition = glm::vec4(camera.Position, 1.0f);
+        frameBlock.data.time = currentFrame;
+        frameBlock.data.deltaTime = deltaTime;
+        frameBlock.upload();
+
+        // first light on or off, second light always on; positions go to the shaders in view space. Only lights
+        // that are on are uploaded, so a light that is off costs nothing in the shader
+        int lightCount = 0;
         if (lightOn)
-            phongShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
+        {
+            lightBlock.data.lights[lightCount].position = view * glm::vec4(1.2f, 1.0f, 2.0f, 1.0f);
+            lightBlock.data.lights[lightCount].color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+            lightCount++;
+        }
+        lightBlock.data.lights[lightCount].position = view * glm::vec4(5.0f, 1.0f, 2.0f, 1.0f);
+        lightBlock.data.lights[lightCount].color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+        lightCount++;
+        lightBlock.data.lightCount = lightCount;
+        lightBlock.upload();
+
+        // clustered lights: animate, then sort into the view's clusters (no lights at all when switched off)
+        if (clusteredLightsOn)
+        {
+            for (unsigned int i = 0; i < CLUSTERED_LIGHT_COUNT; i++)
+                clusteredLights[i].position = lightAnchors[i] + glm::vec3(0.0f, 0.6f + 0.5f * std::sin(currentFrame + i * 0.37f), 0.0f);
+        }
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        lightClusterer.update(clusteredLightsOn ? clusteredLights : std::vector<PointLight>(), view, glm::radians(45.0f),
+                              (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE,
+                              glm::max(framebufferWidth, 1), glm::max(framebufferHeight, 1));
+
+        // wireframe view of the sphere, forward only: the G-buffer has no room for the edges
+        bool sphereWireframe = wireframeOn && !deferredShadingOn;
+        SceneObject& sphere = scene[SCENE_SPHERE];
+        sphere.variants = sphereWireframe ? nullptr : &phongVariants;
+        sphere.shader = sphereWireframe ? &wireframeShader : sphere.shader;
+        sphere.lod = sphereWireframe ? nullptr : &sphereLod;
+        sphere.vao = sphereWireframe ? wireframeSphere.getVao() : sphereGeometry.vao;
+        sphere.count = sphereWireframe ? wireframeSphere.getIndexCount() : sphereGeometry.count;
+
+        // smallest permutation for each object: this frame's light count and the features it uses
+        unsigned int frameFeatures = (clusteredLightsOn ? PERMUTATION_CLUSTERED : 0) | (shadowsOn ? PERMUTATION_SHADOWED : 0);
+        for (std::size_t i = 0; i < scene.size(); i++)
+            if (scene[i].variants != nullptr)
+                scene[i].shader = &scene[i].variants->select(ShaderVariants::key(lightCount, scene[i].features | frameFeatures));
+
+        // world, model-view, MVP and normal matrices of the whole scene, in SIMD batches on the workers
+        drawListBuilder.setViewportHeight(framebufferHeight);
+        drawListBuilder.updateTransforms(scene, currentFrame, view, projection);
+
+        // sun shadows: cascades fitted to the camera, casters drawn position-only before any scene pass
+        shadowMapper.update(camera, view, glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, NEAR_PLANE, FAR_PLANE,
+                            SUN_DIRECTION, SUN_COLOR, shadowsOn);
+        if (shadowsOn)
+        {
+            passTimer.begin(TIMER_SHADOW_PASS);
+            shadowMapper.render(scene, drawListBuilder, framebufferWidth, framebufferHeight);
+            passTimer.end();
+        }
+
+        // rasterize the occluders on the workers before anything is submitted
+        occlusionCuller.begin(projection * view);
+        if (occlusionCullingOn)
+        {
+            occlusionCuller.occlude(rockOccluder, drawListBuilder.transform(SCENE_ROCK));
+            occlusionCuller.occlude(cyborgOccluder, drawListBuilder.transform(SCENE_CYBORG));
+        }
+        occlusionCuller.rasterize();
+
+        // pick up the GPU occlusion results that have arrived by now
+        occlusionQueries.beginFrame(projection * view);
+
+        // collect this frame's draws: culled and packetized in parallel ranges, merged in object order;
+        // the queue decides the order they are issued in
+        renderQueue.begin(view, projection, FAR_PLANE);
+        renderQueue.setOcclusion(occlusionQueriesOn ? &occlusionQueries : nullptr);
+        drawListBuilder.build(scene, renderQueue, occlusionCullingOn ? &occlusionCuller : nullptr, deferredShadingOn);
+
+        // sort by state and depth, then draw
+        renderQueue.sort();
+
+        // deferred: everything up to the lighting pass goes to the G-buffer instead of the screen; a minimized
+        // window has a 0x0 framebuffer, which the G-buffer textures can't be sized to
+        if (deferredShadingOn)
+            deferredRenderer.beginGeometry(glm::max(framebufferWidth, 1), glm::max(framebufferHeight, 1));
+
+        // depth prepass: lay down the final depth with a position-only program, so the color pass below shades
+        // each pixel once (GL_LEQUAL, no depth writes) however many lights the fragment shader loops over
+        if (depthPrepassOn)
+        {
+            passTimer.begin(TIMER_DEPTH_PREPASS);
+            renderQueue.executeDepthOnly(depthShader, &ditheredDepthShader);
+            passTimer.end();
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+        }
+
+        passTimer.begin(TIMER_COLOR_PASS);
+        // the fallback program has no indirect variant: batch only once both model programs are real
+        if (indirectRenderer && programPipeline.ready(modelShader) && programPipeline.ready(*modelShaderIndirect))
+            indirectRenderer->execute(renderQueue);
         else
-            phongShader.setVec3("lightColor", glm::vec3(0.0f, 0.0f, 0.0f));
-
-        phongShader.setVec3("objectColor", glm::vec3(1.0f, 0.5f, 0.31f));
-
-        // second light
-        phongShader.setVec3("lightPos2", glm::vec3(5.0f, 1.0f, 2.0f));
-        phongShader.setVec3("lightColor2", glm::vec3(1.0f, 1.0f, 1.0f));
-
-        // render sphere
-        glm::mat4 sphereModel = glm::mat4(1.0f);
-        sphereModel = glm::translate(sphereModel, glm::vec3(0.0f, 1.5f, 0.0f));
-        sphereModel = glm::scale(sphereModel, glm::vec3(0.5f));
-        phongShader.setMat4("model", sphereModel);
-
-        // draw a sphere with VAO
-        glBindVertexArray(sphereVAO);
-        glDrawElements(GL_TRIANGLES,                    // primitive type
-            sphere.getIndexCount(),          // # of indices
-            GL_UNSIGNED_INT,                 // data type
-            (void*)0);                       // offset to indices
-
-		// render rotating cube
-        glm::mat4 cubeModel = glm::mat4(1.0f);
-        cubeModel = glm::rotate(cubeModel, (float)glfwGetTime(), glm::vec3(0.5f, 1.0f, 0.0f));
-        phongShader.setMat4("model", cubeModel);
-
-        phongShader.setMat4("view", view);
-        phongShader.setMat4("projection", projection);
-
-        glBindVertexArray(cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+            renderQueue.execute();
+        if (depthPrepassOn)
+        {
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+        }
+        // last frame's occluded packets weren't part of the prepass, they write depth as usual
+        renderQueue.executeOccluded();
+        // the light markers are unlit: forward only, the deferred lighting pass has no depth to test them against
+        if (lightMarkersOn && clusteredLightsOn && !deferredShadingOn)
+            lightMarkers.draw(lightClusterer.stats().lights, LIGHT_MARKER_SCALE);
+        // the impostors write their ray-cast depth, so they go after the prepass state is restored; forward only
+        if (impostorsOn && !deferredShadingOn)
+            impostors.draw();
+        passTimer.end();
+
+        if (deferredShadingOn)
+        {
+            passTimer.begin(TIMER_LIGHTING_PASS);
+            deferredRenderer.light(clusteredLightsOn ? lightClusterer.stats().lights : 0);
+            passTimer.end();
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteBuffers(1, &cubeVBO);
+    glState().deleteVertexArray(cubeVAO);
+    glState().deleteVertexArray(lightCubeVAO);
+    glState().deleteBuffer(cubeVBO);
+    geometryRegistry.release();
+    wireframeSphere.releaseBuffers();
+    frameBlock.release();
+    lightBlock.release();
+    materialAtlas.release();
+    renderQueue.release();
+    occlusionQueries.release();
+    deferredRenderer.release();
+    shadowMapper.release();
+    lightClusterer.release();
+    lightMarkers.release();
+    impostors.release();
+    passTimer.release();
+    if (indirectRenderer)
+        indirectRenderer->release();
+    programPipeline.release();
 
     glfwTerminate();
     return 0;
@@ -293,6 +595,15 @@ int main()
 void processInput(GLFWwindow* window)
 {
     static bool lKeyPressedLastFrame = false;
+    static bool oKeyPressedLastFrame = false;
+    static bool gKeyPressedLastFrame = false;
+    static bool pKeyPressedLastFrame = false;
+    static bool cKeyPressedLastFrame = false;
+    static bool fKeyPressedLastFrame = false;
+    static bool hKeyPressedLastFrame = false;
+    static bool mKeyPressedLastFrame = false;
+    static bool iKeyPressedLastFrame = false;
+    static bool xKeyPressedLastFrame = false;
 
     // close window on ESC key press
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
@@ -306,6 +617,78 @@ void processInput(GLFWwindow* window)
     }
     lKeyPressedLastFrame = lKeyPressedThisFrame;
 
+    // toggle CPU occlusion culling on O key press
+    bool oKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (oKeyPressedThisFrame && !oKeyPressedLastFrame)
+    {
+        occlusionCullingOn = !occlusionCullingOn;
+    }
+    oKeyPressedLastFrame = oKeyPressedThisFrame;
+
+    // toggle GPU occlusion queries on G key press
+    bool gKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+    if (gKeyPressedThisFrame && !gKeyPressedLastFrame)
+    {
+        occlusionQueriesOn = !occlusionQueriesOn;
+    }
+    gKeyPressedLastFrame = gKeyPressedThisFrame;
+
+    // toggle the depth prepass on P key press
+    bool pKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (pKeyPressedThisFrame && !pKeyPressedLastFrame)
+    {
+        depthPrepassOn = !depthPrepassOn;
+    }
+    pKeyPressedLastFrame = pKeyPressedThisFrame;
+
+    // toggle the clustered point lights on C key press
+    bool cKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (cKeyPressedThisFrame && !cKeyPressedLastFrame)
+    {
+        clusteredLightsOn = !clusteredLightsOn;
+    }
+    cKeyPressedLastFrame = cKeyPressedThisFrame;
+
+    // switch between forward and deferred shading on F key press
+    bool fKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (fKeyPressedThisFrame && !fKeyPressedLastFrame)
+    {
+        deferredShadingOn = !deferredShadingOn;
+    }
+    fKeyPressedLastFrame = fKeyPressedThisFrame;
+
+    // toggle the sun's shadows on H key press
+    bool hKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    if (hKeyPressedThisFrame && !hKeyPressedLastFrame)
+    {
+        shadowsOn = !shadowsOn;
+    }
+    hKeyPressedLastFrame = hKeyPressedThisFrame;
+
+    // toggle the clustered light markers on M key press
+    bool mKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (mKeyPressedThisFrame && !mKeyPressedLastFrame)
+    {
+        lightMarkersOn = !lightMarkersOn;
+    }
+    mKeyPressedLastFrame = mKeyPressedThisFrame;
+
+    // toggle the sphere impostor cloud on I key press
+    bool iKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS;
+    if (iKeyPressedThisFrame && !iKeyPressedLastFrame)
+    {
+        impostorsOn = !impostorsOn;
+    }
+    iKeyPressedLastFrame = iKeyPressedThisFrame;
+
+    // toggle the sphere's wireframe view on X key press
+    bool xKeyPressedThisFrame = glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS;
+    if (xKeyPressedThisFrame && !xKeyPressedLastFrame)
+    {
+        wireframeOn = !wireframeOn;
+    }
+    xKeyPressedLastFrame = xKeyPressedThisFrame;
+
     // camera movement
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
         camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -317,6 +700,53 @@ void processInput(GLFWwindow* window)
         camera.ProcessKeyboard(RIGHT, deltaTime);
 }
 
+// show frame time, GPU pass times, the GL state cache counters of the last frame and the occlusion results in the
+// window title, refreshed once a second
+// ---------------------------------------------------------------------------------------------------------------
+void updateWindowTitle(GLFWwindow* window, float currentFrame, const OcclusionCuller& culler, const OcclusionQueries& queries,
+                       const GpuTimer& timer, const LightClusterer& clusters, const ShadowMapper& shadows)
+{
+    static float lastTitleUpdate = 0.0f;
+    if (currentFrame - lastTitleUpdate < 1.0f)
+        return;
+    lastTitleUpdate = currentFrame;
+
+    const GLStateCache::FrameStats& stats = glState().lastFrame();
+    std::ostringstream title;
+    title << "Real-Time Rasterizer | " << deltaTime * 1000.0f << " ms";
+    if (depthPrepassOn)
+        title << " (GPU prepass " << timer.milliseconds(TIMER_DEPTH_PREPASS) << " ms";
+    else
+        title << " (GPU no prepass";
+    if (deferredShadingOn)
+        title << ", G-buffer " << timer.milliseconds(TIMER_COLOR_PASS) << " ms, lighting " << timer.milliseconds(TIMER_LIGHTING_PASS) << " ms)";
+    else
+        title << ", color " << timer.milliseconds(TIMER_COLOR_PASS) << " ms)";
+    if (shadowsOn)
+    {
+        ShadowMapper::Stats cascades = shadows.stats();
+        title << " | shadows " << timer.milliseconds(TIMER_SHADOW_PASS) << " ms (" << cascades.casterDraws << " draws, "
+              << cascades.staticRedraws << " static cascades redrawn)";
+    }
+    title << " | GL calls: " << stats.callsIssued << " issued, " << stats.callsSkipped << " skipped";
+    if (occlusionCullingOn)
+    {
+        OcclusionCuller::Stats occlusion = culler.stats();
+        title << " | occluded: " << occlusion.culled << "/" << occlusion.tested;
+    }
+    if (occlusionQueriesOn)
+    {
+        OcclusionQueries::Stats gpu = queries.stats();
+        title << " | GPU hidden: " << gpu.hidden << " (" << gpu.issued << " queries)";
+    }
+    if (clusteredLightsOn)
+    {
+        LightClusterer::Stats lights = clusters.stats();
+        title << " | clustered lights: " << lights.lights << " (" << lights.indices << " refs, busiest " << lights.busiest << ")";
+    }
+    glfwSetWindowTitle(window, title.str().c_str());
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
@@ -0,0 +1,210 @@
+#ifndef MATERIAL_ATLAS_H
+#define MATERIAL_ATLAS_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "mesh.h"
+#include "model.h"
+
+#include <map>
+#include <vector>
+
+// Moves the 2D material textures of loaded models into GL_TEXTURE_2D_ARRAYs, one array per (width, height,
+// format) group, and gives every mesh a MeshMaterial that names the arrays and the layers inside them.
+// Meshes whose textures ended up in the same arrays then differ only by layer index, which travels as
+// per-draw data, so they can be drawn back to back (or in one multi-draw) without rebinding textures.
+//
+// Meshes without a diffuse or specular map point at a 1x1 white layer instead.
+class MaterialAtlas
+{
+public:
+    // queue the textures of a model, call build() once all models are added
+    // ------------------------------------------------------------------------
+    void addModel(Model& model)
+    {
+        models.push_back(&model);
+    }
+
+    // read back every referenced texture, pack them into arrays and assign each mesh its material;
+    // the original 2D textures are deleted afterwards
+    // ------------------------------------------------------------------------
+    void build()
+    {
+        // 1. collect the unique source textures and their group
+        std::map<GLuint, Slot> slots;
+        Slot white = addLayer(0);
+        for (std::size_t m = 0; m < models.size(); m++)
+        {
+            for (std::size_t i = 0; i < models[m]->meshes.size(); i++)
+            {
+                const Mesh& mesh = models[m]->meshes[i];
+                for (std::size_t t = 0; t < mesh.textures.size(); t++)
+                {
+                    const Texture& texture = mesh.textures[t];
+                    if ((texture.type == "texture_diffuse" || texture.type == "texture_specular") &&
+                        texture.id != 0 && slots.find(texture.id) == slots.end())
+                        slots[texture.id] = addLayer(texture.id);
+                }
+            }
+        }
+
+        // 2. allocate each group's array and copy the layers over
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (std::size_t g = 0; g < groups.size(); g++)
+            uploadGroup(groups[g]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        // 3. point every mesh at its layers and drop the now redundant 2D textures
+        for (std::size_t m = 0; m < models.size(); m++)
+        {
+            for (std::size_t i = 0; i < models[m]->meshes.size(); i++)
+            {
+                Mesh& mesh = models[m]->meshes[i];
+                Slot diffuse = white, specular = white;
+                bool hasDiffuse = false, hasSpecular = false;
+                for (std::size_t t = 0; t < mesh.textures.size(); t++)
+                {
+                    std::map<GLuint, Slot>::const_iterator slot = slots.find(mesh.textures[t].id);
+                    if (slot == slots.end())
+                        continue;
+                    // like Mesh::bindTextures, only the first map of each kind is used (texture_diffuse1 / texture_specular1)
+                    if (mesh.textures[t].type == "texture_diffuse" && !hasDiffuse)
+                    {
+                        diffuse = slot->second;
+                        hasDiffuse = true;
+                    }
+                    else if (mesh.textures[t].type == "texture_specular" && !hasSpecular)
+                    {
+                        specular = slot->second;
+                        hasSpecular = true;
+                    }
+                }
+                mesh.material.diffuseArray = groups[diffuse.group].array;
+                mesh.material.diffuseLayer = diffuse.layer;
+                mesh.material.specularArray = groups[specular.group].array;
+                mesh.material.specularLayer = specular.layer;
+            }
+        }
+        for (std::map<GLuint, Slot>::const_iterator it = slots.begin(); it != slots.end(); ++it)
+            glState().deleteTexture(it->first);
+        for (std::size_t m = 0; m < models.size(); m++)
+            forgetTextures(*models[m], slots);
+        models.clear();
+    }
+
+    // delete the texture arrays, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (std::size_t i = 0; i < groups.size(); i++)
+            glState().deleteTexture(groups[i].array);
+        groups.clear();
+    }
+
+    // number of texture arrays the materials ended up in
+    std::size_t arrayCount() const { return groups.size(); }
+
+private:
+    struct Group {
+        GLsizei width;
+        GLsizei height;
+        GLenum format;              // GL_RED / GL_RGB / GL_RGBA, as created by TextureFromFile
+        std::vector<GLuint> sources; // source texture per layer, 0 = white
+        GLuint array = 0;
+    };
+    struct Slot {
+        std::size_t group;
+        GLint layer;
+    };
+
+    std::vector<Model*> models;
+    std::vector<Group> groups;
+
+    // find (or start) the group matching the texture's size and format and reserve a layer in it
+    Slot addLayer(GLuint texture)
+    {
+        GLint width = 1, height = 1, format = GL_RGBA;
+        if (texture != 0)
+        {
+            glState().bindTexture(0, GL_TEXTURE_2D, texture);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            format = baseFormat(format);
+        }
+
+        Slot slot;
+        for (slot.group = 0; slot.group < groups.size(); slot.group++)
+        {
+            const Group& group = groups[slot.group];
+            if (group.width == width && group.height == height && group.format == static_cast<GLenum>(format))
+                break;
+        }
+        if (slot.group == groups.size())
+        {
+            Group group;
+            group.width = width;
+            group.height = height;
+            group.format = static_cast<GLenum>(format);
+            groups.push_back(group);
+        }
+        slot.layer = static_cast<GLint>(groups[slot.group].sources.size());
+        groups[slot.group].sources.push_back(texture);
+        return slot;
+    }
+
+    void uploadGroup(Group& group)
+    {
+        std::size_t channels = group.format == GL_RED ? 1 : (group.format == GL_RGB ? 3 : 4);
+        GLenum internalFormat = group.format == GL_RED ? GL_R8 : (group.format == GL_RGB ? GL_RGB8 : GL_RGBA8);
+        GLsizei layers = static_cast<GLsizei>(group.sources.size());
+
+        glGenTextures(1, &group.array);
+        glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, group.array);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, group.width, group.height, layers, 0, group.format, GL_UNSIGNED_BYTE, nullptr);
+
+        std::vector<unsigned char> pixels(group.width * group.height * channels, 255);
+        for (GLsizei layer = 0; layer < layers; layer++)
+        {
+            GLuint source = group.sources[layer];
+            if (source != 0)
+            {
+                glState().bindTexture(0, GL_TEXTURE_2D, source);
+                glGetTexImage(GL_TEXTURE_2D, 0, group.format, GL_UNSIGNED_BYTE, pixels.data());
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, group.width, group.height, 1, group.format, GL_UNSIGNED_BYTE, pixels.data());
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // the deleted 2D textures must not be bound again through Mesh::textures / Model::textures_loaded
+    static void forgetTextures(Model& model, const std::map<GLuint, Slot>& slots)
+    {
+        for (std::size_t i = 0; i < model.textures_loaded.size(); i++)
+            if (slots.find(model.textures_loaded[i].id) != slots.end())
+                model.textures_loaded[i].id = 0;
+        for (std::size_t i = 0; i < model.meshes.size(); i++)
+            for (std::size_t t = 0; t < model.meshes[i].textures.size(); t++)
+                if (slots.find(model.meshes[i].textures[t].id) != slots.end())
+                    model.meshes[i].textures[t].id = 0;
+    }
+
+    static GLint baseFormat(GLint internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_RED: case GL_R8: return GL_RED;
+        case GL_RGB: case GL_RGB8: return GL_RGB;
+        default: return GL_RGBA;
+        }
+    }
+};
+#endif
@@ -7,7 +7,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "gl_state.h"
 
+#include <cstdio>
 #include <string>
 #include <vector>
 using namespace std;
@@ -37,12 +39,27 @@ struct Texture {
     string path;
 };
 
+// material packed into texture arrays by MaterialAtlas: the arrays to bind and the layers inside them
+struct MeshMaterial {
+    GLuint diffuseArray = 0;    // 0 = not in an atlas, the mesh binds its own textures
+    GLint  diffuseLayer = 0;
+    GLuint specularArray = 0;
+    GLint  specularLayer = 0;
+};
+
+// texture units the atlas arrays are bound to, matching the materialDiffuse/materialSpecular samplers
+#define MATERIAL_DIFFUSE_UNIT 0
+#define MATERIAL_SPECULAR_UNIT 1
+
 class Mesh {
 public:
     // mesh Data
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
+    MeshMaterial         material;
+    glm::vec3            boundsMin;  // object-space bounding box of the vertices
+    glm::vec3            boundsMax;
     unsigned int VAO;
 
     // constructor
@@ -51,13 +68,82 @@ public:
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        computeBounds();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
+    // axis-aligned bounds of the vertex positions, used for culling
+    void computeBounds()
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        if (vertices.empty())
+            return;
+        boundsMin = boundsMax = vertices[0].Position;
+        for (unsigned int i = 1; i < vertices.size(); i++)
+        {
+            boundsMin = glm::min(boundsMin, vertices[i].Position);
+            boundsMax = glm::max(boundsMax, vertices[i].Position);
+        }
+    }
+
+    // describe the Vertex layout to the currently bound VAO/VBO (shared with the indirect geometry pool)
+    static void setVertexAttributes()
+    {
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // vertex tangent
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        // vertex bitangent
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        // ids
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
+
+        // weights
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+    }
+
     // render the mesh
-    void Draw(Shader& shader)
+    void Draw(Shader& shader) const
+    {
+        if (material.diffuseArray != 0)
+        {
+            // atlas material: same arrays for many meshes, only the layers change per draw
+            bindMaterialArrays();
+            shader.setIVec2("materialLayers", material.diffuseLayer, material.specularLayer);
+        }
+        else
+            bindTextures(shader);
+
+        // draw mesh
+        // no unbinding afterwards: every bind goes through the state cache, so leftover bindings are harmless
+        // and leaving them in place lets the next mesh with the same VAO/textures skip its binds entirely.
+        glState().bindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+    // bind the texture arrays holding this mesh's atlas material
+    void bindMaterialArrays() const
+    {
+        glState().bindTexture(MATERIAL_DIFFUSE_UNIT, GL_TEXTURE_2D_ARRAY, material.diffuseArray);
+        glState().bindTexture(MATERIAL_SPECULAR_UNIT, GL_TEXTURE_2D_ARRAY, material.specularArray);
+    }
+
+    // bind this mesh's textures to consecutive units and point the texture_<type>N samplers at them
+    void bindTextures(Shader& shader) const
     {
         // bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -66,32 +152,26 @@ public:
         unsigned int heightNr = 1;
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
+            unsigned int number = 0;
+            const string& name = textures[i].type;
             if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
+                number = diffuseNr++;
             else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
+                number = specularNr++;
             else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
+                number = normalNr++;
             else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+                number = heightNr++;
+
+            // now set the sampler to the correct texture unit; the name is hashed in place, no string is built
+            char digits[12] = "";
+            if (number != 0)
+                snprintf(digits, sizeof(digits), "%u", number);
+            shader.set(Uniform<int>(shaderHash(digits, shaderHash(name.c_str()))), static_cast<int>(i));
+            // and finally bind the texture (the state cache activates unit i only if the bind is really needed)
+            glState().bindTexture(i, GL_TEXTURE_2D, textures[i].id);
         }
-
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
 private:
@@ -106,41 +186,20 @@ private:
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        glState().bindVertexArray(VAO);
         // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
 
         // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        // ids
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        setVertexAttributes();
+        glState().bindVertexArray(0);
     }
 };
 #endif#pragma once
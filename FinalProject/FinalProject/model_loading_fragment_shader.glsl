@@ -2,10 +2,12 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+flat in ivec2 MaterialLayers;
 
-uniform sampler2D texture_diffuse1;
+// material atlas arrays, the layer to sample comes with each draw
+uniform sampler2DArray materialDiffuse;
 
 void main()
 {    
-    FragColor = texture(texture_diffuse1, TexCoords);
+    FragColor = texture(materialDiffuse, vec3(TexCoords, MaterialLayers.x));
 }
\ No newline at end of file
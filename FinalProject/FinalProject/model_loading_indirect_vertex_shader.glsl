@@ -0,0 +1,39 @@
+#version 460 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+flat out ivec2 MaterialLayers;
+
+// one entry per indirect draw command, written by IndirectRenderer every frame
+struct DrawData
+{
+    mat4 modelViewProjection;
+    ivec4 material; // x = diffuse layer, y = specular layer
+};
+layout (std430, binding = 0) readonly buffer DrawDataBuffer
+{
+    DrawData draws[];
+};
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+uniform int drawBase; // index of the batch's first command, gl_DrawID restarts at 0 for every multi-draw
+
+void main()
+{
+    DrawData draw = draws[drawBase + gl_DrawID];
+    TexCoords = aTexCoords;    
+    MaterialLayers = draw.material.xy;
+    gl_Position = draw.modelViewProjection * vec4(aPos, 1.0);
+}
@@ -0,0 +1,444 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "model.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define OCCLUSION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles AVX2 intrinsics anywhere; GCC/Clang need the function itself marked for the target
+#if defined(OCCLUSION_X86) && (defined(__GNUC__) || defined(__clang__))
+#define OCCLUSION_AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define OCCLUSION_AVX2_FUNCTION
+#endif
+
+// CPU occlusion culling against a small software depth buffer.
+//
+// Each frame a few large occluders (whole models) are rasterized into a WIDTH x HEIGHT depth buffer on the
+// worker pool: vertices are transformed in parallel chunks, then every band of rows is rasterized by its own
+// job, eight pixels at a time with AVX2 when the CPU has it. A per-tile maximum depth (like the coarse
+// layer of masked occlusion culling) lets most bound tests finish without touching single pixels.
+// visible() then tests a bounding box against that buffer on the CPU, in the same frame, with no GPU
+// readback. Objects whose box crosses the near plane always count as visible, so the test is conservative
+// apart from the coarse resolution of the buffer.
+class OcclusionCuller
+{
+public:
+    enum {
+        WIDTH = 256,
+        HEIGHT = 128,
+        TILE_SIZE = 8,      // HiZ tile edge in pixels
+        BAND_ROWS = 16      // rows rasterized by one job
+    };
+
+    struct Stats {
+        unsigned int occluderTriangles = 0;
+        unsigned int tested = 0;
+        unsigned int culled = 0;
+    };
+
+    explicit OcclusionCuller(WorkerPool& pool)
+        : pool(pool), depth(WIDTH * HEIGHT, 1.0f), tileMax(TILES_X * TILES_Y, 1.0f)
+    {
+        useAVX2 = cpuHasAVX2();
+    }
+
+    // register occluder geometry (copied); returns the handle passed to occlude()
+    // ------------------------------------------------------------------------
+    unsigned int addOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+    {
+        Occluder occluder;
+        occluder.positions = positions;
+        occluder.indices = indices;
+        occluders.push_back(occluder);
+        return static_cast<unsigned int>(occluders.size() - 1);
+    }
+
+    // every mesh of a model as one occluder
+    // ------------------------------------------------------------------------
+    unsigned int addOccluder(const Model& model)
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+        for (unsigned int m = 0; m < model.meshes.size(); m++)
+        {
+            const Mesh& mesh = model.meshes[m];
+            unsigned int base = static_cast<unsigned int>(positions.size());
+            for (unsigned int i = 0; i < mesh.vertices.size(); i++)
+                positions.push_back(mesh.vertices[i].Position);
+            for (unsigned int i = 0; i < mesh.indices.size(); i++)
+                indices.push_back(base + mesh.indices[i]);
+        }
+        return addOccluder(positions, indices);
+    }
+
+    // start a new frame: clears the occluder list for this viewProjection
+    // ------------------------------------------------------------------------
+    void begin(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        instances.clear();
+        triangleCount = 0;
+        tested = 0;
+        culled = 0;
+    }
+
+    // draw a registered occluder with this model matrix into the depth buffer at rasterize()
+    // ------------------------------------------------------------------------
+    void occlude(unsigned int occluder, const glm::mat4& model)
+    {
+        Instance instance;
+        instance.occluder = occluder;
+        instance.mvp = viewProjection * model;
+        instance.firstVertex = 0;
+        instance.firstTriangle = 0;
+        instances.push_back(instance);
+    }
+
+    // clear the depth buffer and rasterize this frame's occluders, returns when the buffer is complete
+    // ------------------------------------------------------------------------
+    void rasterize()
+    {
+        // 1. lay the instances out in the shared vertex and triangle arrays
+        unsigned int vertexCount = 0;
+        triangleCount = 0;
+        jobs.clear();
+        for (std::size_t i = 0; i < instances.size(); i++)
+        {
+            const Occluder& occluder = occluders[instances[i].occluder];
+            instances[i].firstVertex = vertexCount;
+            instances[i].firstTriangle = triangleCount;
+            unsigned int vertices = static_cast<unsigned int>(occluder.positions.size());
+            unsigned int triangles = static_cast<unsigned int>(occluder.indices.size() / 3);
+            for (unsigned int begin = 0; begin < std::max(vertices, triangles); begin += CHUNK)
+            {
+                Job job = { static_cast<unsigned int>(i), begin, begin + CHUNK };
+                jobs.push_back(job);
+            }
+            vertexCount += vertices;
+            triangleCount += triangles;
+        }
+        screen.resize(vertexCount);
+        setups.resize(triangleCount);
+
+        // 2. project the vertices, then set up the triangles (both in chunks across the pool)
+        pool.parallelFor(static_cast<unsigned int>(jobs.size()), [this](unsigned int j) { transformChunk(jobs[j]); });
+        pool.parallelFor(static_cast<unsigned int>(jobs.size()), [this](unsigned int j) { setupChunk(jobs[j]); });
+
+        // 3. every band clears and fills its own rows, then updates its HiZ tiles
+        pool.parallelFor(HEIGHT / BAND_ROWS, [this](unsigned int band) { rasterizeBand(band); });
+    }
+
+    // true if any part of the box (object space, placed by model) may be in front of the occluders
+    // ------------------------------------------------------------------------
+    bool visible(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model) const
+    {
+        tested++;
+        glm::mat4 mvp = viewProjection * model;
+        float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+        for (int c = 0; c < 8; c++)
+        {
+            glm::vec4 corner((c & 1) ? boundsMax.x : boundsMin.x, (c & 2) ? boundsMax.y : boundsMin.y,
+                             (c & 4) ? boundsMax.z : boundsMin.z, 1.0f);
+            glm::vec4 clip = mvp * corner;
+            if (clip.w <= NEAR_W)
+                return true;    // crosses the near plane, can't be bounded on screen
+            float invW = 1.0f / clip.w;
+            float x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+            float y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            nearest = std::min(nearest, clip.z * invW * 0.5f + 0.5f);
+        }
+
+        // clamp in float first, far off-screen corners don't fit an int
+        int x0 = static_cast<int>(std::floor(glm::clamp(minX, 0.0f, float(WIDTH))));
+        int x1 = static_cast<int>(std::ceil(glm::clamp(maxX, 0.0f, float(WIDTH))));
+        int y0 = static_cast<int>(std::floor(glm::clamp(minY, 0.0f, float(HEIGHT))));
+        int y1 = static_cast<int>(std::ceil(glm::clamp(maxY, 0.0f, float(HEIGHT))));
+        if (x0 >= x1 || y0 >= y1 || nearest > 1.0f)
+        {
+            culled++;   // entirely off screen or beyond the far plane
+            return false;
+        }
+
+        for (int ty = y0 / TILE_SIZE; ty <= (y1 - 1) / TILE_SIZE; ty++)
+        {
+            for (int tx = x0 / TILE_SIZE; tx <= (x1 - 1) / TILE_SIZE; tx++)
+            {
+                // the whole tile is closer than the box's nearest point
+                if (tileMax[ty * TILES_X + tx] < nearest)
+                    continue;
+                int py1 = std::min(y1, (ty + 1) * TILE_SIZE);
+                int px1 = std::min(x1, (tx + 1) * TILE_SIZE);
+                for (int py = std::max(y0, ty * TILE_SIZE); py < py1; py++)
+                    for (int px = std::max(x0, tx * TILE_SIZE); px < px1; px++)
+                        if (depth[py * WIDTH + px] >= nearest)
+                            return true;
+            }
+        }
+        culled++;
+        return false;
+    }
+
+    Stats stats() const
+    {
+        Stats result;
+        result.occluderTriangles = triangleCount;
+        result.tested = tested;
+        result.culled = culled;
+        return result;
+    }
+
+    bool simd() const { return useAVX2; }
+
+private:
+    enum {
+        TILES_X = WIDTH / TILE_SIZE,
+        TILES_Y = HEIGHT / TILE_SIZE
+    };
+    static const unsigned int CHUNK = 4096;     // vertices or triangles per job
+    static constexpr float NEAR_W = 1e-4f;
+
+    struct Occluder {
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> indices;
+    };
+    struct Instance {
+        unsigned int occluder;
+        glm::mat4 mvp;
+        unsigned int firstVertex;
+        unsigned int firstTriangle;
+    };
+    struct Job {
+        unsigned int instance;
+        unsigned int begin;
+        unsigned int end;
+    };
+    // window-space vertex, w <= 0 marks one behind the near plane
+    struct ScreenVertex {
+        float x, y, z, w;
+    };
+    // edge functions E(x, y) = a x + b y + c (>= 0 inside) and the depth plane z = za x + zb y + zc
+    struct TriangleSetup {
+        float a[3], b[3], c[3];
+        float za, zb, zc;
+        int minX, maxX, minY, maxY;     // pixel bounds, max exclusive; minY == maxY skips the triangle
+    };
+
+    WorkerPool& pool;
+    std::vector<float> depth;
+    std::vector<float> tileMax;
+    std::vector<Occluder> occluders;
+    std::vector<Instance> instances;
+    std::vector<Job> jobs;
+    std::vector<ScreenVertex> screen;
+    std::vector<TriangleSetup> setups;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    unsigned int triangleCount = 0;
+    bool useAVX2 = false;
+    mutable std::atomic<unsigned int> tested{ 0 };
+    mutable std::atomic<unsigned int> culled{ 0 };
+
+    void transformChunk(const Job& job)
+    {
+        const Instance& instance = instances[job.instance];
+        const std::vector<glm::vec3>& positions = occluders[instance.occluder].positions;
+        unsigned int end = std::min(job.end, static_cast<unsigned int>(positions.size()));
+        for (unsigned int i = job.begin; i < end; i++)
+        {
+            glm::vec4 clip = instance.mvp * glm::vec4(positions[i], 1.0f);
+            ScreenVertex& out = screen[instance.firstVertex + i];
+            out.w = clip.w;
+            if (clip.w <= NEAR_W)
+                continue;
+            float invW = 1.0f / clip.w;
+            out.x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+            out.y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+            out.z = clip.z * invW * 0.5f + 0.5f;
+        }
+    }
+
+    void setupChunk(const Job& job)
+    {
+        const Instance& instance = instances[job.instance];
+        const std::vector<unsigned int>& indices = occluders[instance.occluder].indices;
+        unsigned int end = std::min(job.end, static_cast<unsigned int>(indices.size() / 3));
+        for (unsigned int t = job.begin; t < end; t++)
+        {
+            TriangleSetup& setup = setups[instance.firstTriangle + t];
+            setup.minY = setup.maxY = 0;
+            const ScreenVertex& v0 = screen[instance.firstVertex + indices[3 * t + 0]];
+            const ScreenVertex& v1 = screen[instance.firstVertex + indices[3 * t + 1]];
+            const ScreenVertex& v2 = screen[instance.firstVertex + indices[3 * t + 2]];
+            // occluders may only ever hide less: triangles touching the near plane are dropped
+            if (v0.w <= NEAR_W || v1.w <= NEAR_W || v2.w <= NEAR_W)
+                continue;
+
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+            if (std::fabs(area) < 1e-6f)
+                continue;
+            setup.minX = static_cast<int>(std::floor(glm::clamp(std::min(v0.x, std::min(v1.x, v2.x)), 0.0f, float(WIDTH))));
+            setup.maxX = static_cast<int>(std::ceil(glm::clamp(std::max(v0.x, std::max(v1.x, v2.x)), 0.0f, float(WIDTH))));
+            int minY = static_cast<int>(std::floor(glm::clamp(std::min(v0.y, std::min(v1.y, v2.y)), 0.0f, float(HEIGHT))));
+            int maxY = static_cast<int>(std::ceil(glm::clamp(std::max(v0.y, std::max(v1.y, v2.y)), 0.0f, float(HEIGHT))));
+            if (setup.minX >= setup.maxX || minY >= maxY)
+                continue;
+
+            // both windings are rasterized; orient the edges so the inside is positive
+            float sign = area > 0.0f ? 1.0f : -1.0f;
+            const ScreenVertex* v[3] = { &v0, &v1, &v2 };
+            for (int e = 0; e < 3; e++)
+            {
+                // edge e is opposite vertex e, from v[e + 1] to v[e + 2]
+                const ScreenVertex& from = *v[(e + 1) % 3];
+                const ScreenVertex& to = *v[(e + 2) % 3];
+                setup.a[e] = sign * (from.y - to.y);
+                setup.b[e] = sign * (to.x - from.x);
+                setup.c[e] = sign * (from.x * to.y - from.y * to.x);
+            }
+            // E_e / |area| are the barycentric weights of vertex e
+            float invArea = 1.0f / std::fabs(area);
+            setup.za = (v0.z * setup.a[0] + v1.z * setup.a[1] + v2.z * setup.a[2]) * invArea;
+            setup.zb = (v0.z * setup.b[0] + v1.z * setup.b[1] + v2.z * setup.b[2]) * invArea;
+            setup.zc = (v0.z * setup.c[0] + v1.z * setup.c[1] + v2.z * setup.c[2]) * invArea;
+            setup.minY = minY;
+            setup.maxY = maxY;
+        }
+    }
+
+    void rasterizeBand(unsigned int band)
+    {
+        int y0 = static_cast<int>(band) * BAND_ROWS;
+        int y1 = y0 + BAND_ROWS;
+        std::fill(depth.begin() + y0 * WIDTH, depth.begin() + y1 * WIDTH, 1.0f);
+
+        for (unsigned int t = 0; t < triangleCount; t++)
+        {
+            const TriangleSetup& setup = setups[t];
+            int rowBegin = std::max(y0, setup.minY);
+            int rowEnd = std::min(y1, setup.maxY);
+            if (rowBegin >= rowEnd)
+                continue;
+#ifdef OCCLUSION_X86
+            if (useAVX2)
+            {
+                rasterizeRowsAVX2(setup, rowBegin, rowEnd);
+                continue;
+            }
+#endif
+            rasterizeRows(setup, rowBegin, rowEnd);
+        }
+
+        // coarse layer: farthest depth of every tile in this band
+        for (int ty = y0 / TILE_SIZE; ty < y1 / TILE_SIZE; ty++)
+        {
+            for (int tx = 0; tx < TILES_X; tx++)
+            {
+                float farthest = 0.0f;
+                for (int py = ty * TILE_SIZE; py < (ty + 1) * TILE_SIZE; py++)
+                    for (int px = tx * TILE_SIZE; px < (tx + 1) * TILE_SIZE; px++)
+                        farthest = std::max(farthest, depth[py * WIDTH + px]);
+                tileMax[ty * TILES_X + tx] = farthest;
+            }
+        }
+    }
+
+    // pixel centers inside all three edges take the nearer of the stored and the triangle depth
+    void rasterizeRows(const TriangleSetup& setup, int rowBegin, int rowEnd)
+    {
+        for (int y = rowBegin; y < rowEnd; y++)
+        {
+            float py = y + 0.5f;
+            float* row = &depth[y * WIDTH];
+            for (int x = setup.minX; x < setup.maxX; x++)
+            {
+                float px = x + 0.5f;
+                if (setup.a[0] * px + setup.b[0] * py + setup.c[0] < 0.0f ||
+                    setup.a[1] * px + setup.b[1] * py + setup.c[1] < 0.0f ||
+                    setup.a[2] * px + setup.b[2] * py + setup.c[2] < 0.0f)
+                    continue;
+                row[x] = std::min(row[x], setup.za * px + setup.zb * py + setup.zc);
+            }
+        }
+    }
+
+#ifdef OCCLUSION_X86
+    // same as rasterizeRows for eight pixels per step; spans start on 8-pixel boundaries, WIDTH is a multiple of 8
+    OCCLUSION_AVX2_FUNCTION void rasterizeRowsAVX2(const TriangleSetup& setup, int rowBegin, int rowEnd)
+    {
+        const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        __m256 a0 = _mm256_set1_ps(setup.a[0]), a1 = _mm256_set1_ps(setup.a[1]), a2 = _mm256_set1_ps(setup.a[2]);
+        __m256 za = _mm256_set1_ps(setup.za);
+        int spanBegin = setup.minX & ~7;
+
+        for (int y = rowBegin; y < rowEnd; y++)
+        {
+            float py = y + 0.5f;
+            __m256 row0 = _mm256_set1_ps(setup.b[0] * py + setup.c[0]);
+            __m256 row1 = _mm256_set1_ps(setup.b[1] * py + setup.c[1]);
+            __m256 row2 = _mm256_set1_ps(setup.b[2] * py + setup.c[2]);
+            __m256 rowZ = _mm256_set1_ps(setup.zb * py + setup.zc);
+            float* row = &depth[y * WIDTH];
+            for (int x = spanBegin; x < setup.maxX; x += 8)
+            {
+                __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane);
+                __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), row0);
+                __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), row1);
+                __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), row2);
+                __m256 inside = _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                                _mm256_and_ps(_mm256_cmp_ps(e1, zero, _CMP_GE_OQ), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ)));
+                if (_mm256_movemask_ps(inside) == 0)
+                    continue;
+                __m256 z = _mm256_add_ps(_mm256_mul_ps(za, px), rowZ);
+                __m256 stored = _mm256_loadu_ps(row + x);
+                _mm256_storeu_ps(row + x, _mm256_blendv_ps(stored, _mm256_min_ps(stored, z), inside));
+            }
+        }
+    }
+#endif
+
+    static bool cpuHasAVX2()
+    {
+#if defined(OCCLUSION_X86) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        // the OS must save the YMM registers on context switches
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#elif defined(OCCLUSION_X86) && (defined(__GNUC__) || defined(__clang__))
+        return __builtin_cpu_supports("avx2") != 0;
+#else
+        return false;
+#endif
+    }
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+};
+#endif
@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// color writes are masked off while proxies are drawn, only the samples passing the depth test matter
+void main()
+{
+    FragColor = vec4(1.0);
+}
\ No newline at end of file
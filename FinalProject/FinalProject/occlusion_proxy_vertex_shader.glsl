@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// unit cube [0,1]^3 -> the bounding box of the queried object in world space
+uniform mat4 proxyModel;
+
+void main()
+{
+    gl_Position = viewProjection * proxyModel * vec4(aPos, 1.0);
+}
\ No newline at end of file
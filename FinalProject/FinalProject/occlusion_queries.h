@@ -0,0 +1,222 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "uniform_blocks.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// GPU occlusion queries with temporal coherence.
+//
+// Every object (a mesh, or any other pointer used as a key) remembers whether its last query found any
+// visible samples. Objects visible last frame are drawn first and act as occluders; the bounding boxes of
+// the objects hidden last frame are then drawn as GL_ANY_SAMPLES_PASSED queries against that depth buffer and
+// the objects themselves are drawn inside glBeginConditionalRender(query, GL_QUERY_NO_WAIT), so the GPU drops
+// them when the box produced no samples without the CPU ever waiting on a result. Visible objects get a
+// query after their draw as well, so they can turn hidden on the next frame.
+//
+// Results are only read once GL_QUERY_RESULT_AVAILABLE says so; until then an object keeps its old state and
+// its pending query. Query objects are recycled through a pool.
+class OcclusionQueries
+{
+public:
+    struct Stats {
+        unsigned int issued = 0;        // proxy draws this frame
+        unsigned int hidden = 0;        // objects whose last result was "no samples"
+    };
+
+    // create the proxy program and box, and pre-fill the query pool
+    // ------------------------------------------------------------------------
+    void create()
+    {
+        proxyShader.reset(new Shader("occlusion_proxy_vertex_shader.glsl", "occlusion_proxy_fragment_shader.glsl"));
+        bindUniformBlocks(proxyShader->ID);
+
+        // unit cube [0,1]^3, scaled onto each bounding box
+        float corners[] = {
+            0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  1.0f, 1.0f, 0.0f,  0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 1.0f, 1.0f
+        };
+        unsigned int faces[] = {
+            0, 2, 1,  0, 3, 2,     // back
+            4, 5, 6,  4, 6, 7,     // front
+            0, 4, 7,  0, 7, 3,     // left
+            1, 2, 6,  1, 6, 5,     // right
+            0, 1, 5,  0, 5, 4,     // bottom
+            3, 7, 6,  3, 6, 2      // top
+        };
+        glGenVertexArrays(1, &boxVAO);
+        glGenBuffers(1, &boxVBO);
+        glGenBuffers(1, &boxEBO);
+        glState().bindVertexArray(boxVAO);
+        glState().bindBuffer(GL_ARRAY_BUFFER, boxVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glState().bindVertexArray(0);
+
+        pool.resize(64);
+        glGenQueries(static_cast<GLsizei>(pool.size()), pool.data());
+    }
+
+    // delete the queries, proxy geometry and program, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (std::unordered_map<const void*, ObjectState>::iterator it = objects.begin(); it != objects.end(); ++it)
+            if (it->second.pending != 0)
+                pool.push_back(it->second.pending);
+        objects.clear();
+        if (!pool.empty())
+            glDeleteQueries(static_cast<GLsizei>(pool.size()), pool.data());
+        pool.clear();
+        if (boxVAO != 0)
+        {
+            glState().deleteVertexArray(boxVAO);
+            glState().deleteBuffer(boxVBO);
+            glState().deleteBuffer(boxEBO);
+            boxVAO = boxVBO = boxEBO = 0;
+        }
+        if (proxyShader)
+        {
+            glState().deleteProgram(proxyShader->ID);
+            proxyShader.reset();
+        }
+    }
+
+    // collect every result that has arrived, without waiting for the others
+    // ------------------------------------------------------------------------
+    void beginFrame(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        frame++;
+        current = Stats();
+        std::unordered_map<const void*, ObjectState>::iterator it = objects.begin();
+        while (it != objects.end())
+        {
+            ObjectState& state = it->second;
+            if (state.pending != 0)
+            {
+                GLuint available = GL_FALSE;
+                glGetQueryObjectuiv(state.pending, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (available)
+                {
+                    GLuint samples = 0;
+                    glGetQueryObjectuiv(state.pending, GL_QUERY_RESULT, &samples);
+                    state.visible = samples != 0;
+                    pool.push_back(state.pending);
+                    state.pending = 0;
+                }
+            }
+            // forget objects that stopped being drawn, once they have no query in flight
+            if (frame - state.lastUsed > FORGET_AFTER_FRAMES && state.pending == 0)
+                it = objects.erase(it);
+            else
+            {
+                if (!state.visible)
+                    current.hidden++;
+                ++it;
+            }
+        }
+    }
+
+    // last known result; objects never queried count as visible
+    bool wasVisible(const void* object) const
+    {
+        std::unordered_map<const void*, ObjectState>::const_iterator it = objects.find(object);
+        return it == objects.end() || it->second.visible;
+    }
+
+    // switch to proxy rendering: no color or depth writes, depth test only
+    // ------------------------------------------------------------------------
+    void beginProxies()
+    {
+        glState().useProgram(proxyShader->ID);
+        glState().bindVertexArray(boxVAO);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        glDepthFunc(GL_LEQUAL);
+    }
+
+    void endProxies()
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+    }
+
+    // query the object's box (between beginProxies/endProxies); returns the query to condition its draw on,
+    // which is the still pending one if the last query hasn't finished, or 0 if the draw must not be skipped
+    // ------------------------------------------------------------------------
+    GLuint query(const void* object, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& model)
+    {
+        ObjectState& state = objects[object];
+        state.lastUsed = frame;
+        if (state.pending != 0)
+            return state.pending;
+
+        // a box reaching behind the near plane gets clipped and would report no samples while the camera sits
+        // inside it; such objects are simply visible
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 size = (boundsMax - boundsMin) * PROXY_INFLATE;
+        glm::mat4 proxyModel = model * glm::translate(glm::mat4(1.0f), center - size * 0.5f) * glm::scale(glm::mat4(1.0f), size);
+        glm::mat4 mvp = viewProjection * proxyModel;
+        for (int c = 0; c < 8; c++)
+        {
+            glm::vec4 clip = mvp * glm::vec4(float(c & 1), float((c >> 1) & 1), float((c >> 2) & 1), 1.0f);
+            if (clip.w <= 1e-4f || clip.z < -clip.w)
+            {
+                state.visible = true;
+                return 0;
+            }
+        }
+
+        if (pool.empty())
+        {
+            pool.resize(32);
+            glGenQueries(static_cast<GLsizei>(pool.size()), pool.data());
+        }
+        state.pending = pool.back();
+        pool.pop_back();
+
+        static const Uniform<glm::mat4> proxyModelUniform("proxyModel");
+        proxyShader->set(proxyModelUniform, proxyModel);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, state.pending);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        current.issued++;
+        return state.pending;
+    }
+
+    Stats stats() const { return current; }
+
+private:
+    static const unsigned long long FORGET_AFTER_FRAMES = 120;
+    // boxes are grown slightly so they never tie with the depth of their own object's faces
+    static constexpr float PROXY_INFLATE = 1.02f;
+
+    struct ObjectState {
+        bool visible = true;
+        GLuint pending = 0;             // query in flight, 0 = none
+        unsigned long long lastUsed = 0;
+    };
+
+    std::unique_ptr<Shader> proxyShader;
+    GLuint boxVAO = 0, boxVBO = 0, boxEBO = 0;
+    std::vector<GLuint> pool;
+    std::unordered_map<const void*, ObjectState> objects;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    unsigned long long frame = 0;
+    Stats current;
+};
+#endif
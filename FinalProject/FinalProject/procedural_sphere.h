@@ -0,0 +1,78 @@
+#ifndef PROCEDURAL_SPHERE_H
+#define PROCEDURAL_SPHERE_H
+
+#include <glad/glad.h>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "uniform_blocks.h"
+
+#include <memory>
+
+// Instanced spheres without any vertex or index buffer. The vertex shader rebuilds every vertex from gl_VertexID
+// with the parametric equations of Sphere::buildVerticesSmooth (six vertices per stack/sector quad) and reads its
+// instance from a texture buffer of two RGBA32F texels per sphere: view space center and radius, color. That is
+// the layout of LightClusterer's clusterLights, so the clustered lights can be drawn as they are.
+//
+// The whole field is one glDrawArraysInstanced; neither the sphere count nor the tessellation costs memory.
+class ProceduralSphere
+{
+public:
+    // the program, reading its instances from the texture buffer bound to `instanceUnit`
+    // ------------------------------------------------------------------------
+    void create(GLint instanceUnit, int sectorCount = 12, int stackCount = 6)
+    {
+        shader.reset(new Shader("procedural_sphere_vertex_shader.glsl", "procedural_sphere_fragment_shader.glsl"));
+        bindUniformBlocks(shader->ID);
+        shader->use();
+        shader->setInt("sphereInstances", instanceUnit);
+        shader->setFloat("radiusScale", 1.0f);
+        setTessellation(sectorCount, stackCount);
+
+        // nothing is read from it, but a core context wants a VAO bound to draw
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    // delete the program and VAO, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        if (shader)
+            glState().deleteProgram(shader->ID);
+        shader.reset();
+        glState().deleteVertexArray(emptyVAO);
+        emptyVAO = 0;
+    }
+
+    // sectors and stacks of every sphere, clamped like Sphere::set
+    // ------------------------------------------------------------------------
+    void setTessellation(int sectorCount, int stackCount)
+    {
+        sectors = sectorCount < 2 ? 2 : sectorCount;
+        stacks = stackCount < 2 ? 2 : stackCount;
+        shader->use();
+        shader->setInt("sectorCount", sectors);
+        shader->setInt("stackCount", stacks);
+    }
+
+    // vertices drawn per sphere
+    GLsizei vertexCount() const { return 6 * sectors * stacks; }
+
+    // draw the first `instances` spheres of the buffer, each radius multiplied by `radiusScale`
+    // ------------------------------------------------------------------------
+    void draw(unsigned int instances, float radiusScale)
+    {
+        if (instances == 0)
+            return;
+        shader->use();
+        shader->setFloat("radiusScale", radiusScale);
+        glState().bindVertexArray(emptyVAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount(), static_cast<GLsizei>(instances));
+    }
+
+private:
+    std::unique_ptr<Shader> shader;
+    GLuint emptyVAO = 0;
+    int sectors = 2, stacks = 2;
+};
+#endif
@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 Normal;
+in vec2 TexCoords;
+flat in vec3 Color;
+
+// unlit: the instance color, darkened towards the silhouette so the spheres read as round (view space normal)
+void main()
+{
+    float facing = max(normalize(Normal).z, 0.0);
+    FragColor = vec4(Color * (0.4 + 0.6 * facing), 1.0);
+}
\ No newline at end of file
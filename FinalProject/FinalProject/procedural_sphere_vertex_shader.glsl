@@ -0,0 +1,49 @@
+#version 330 core
+
+out vec3 Normal;
+out vec2 TexCoords;
+flat out vec3 Color;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// two texels per instance: view space center and radius, color (e.g. the clustered lights)
+uniform samplerBuffer sphereInstances;
+uniform float radiusScale;
+uniform int sectorCount;
+uniform int stackCount;
+
+const float PI = 3.14159265359;
+
+// the corners of the two triangles of a quad, as (stack, sector) steps from its top left vertex k1,
+// in the order of Sphere::buildVerticesSmooth: k1, k2, k1+1 and k1+1, k2, k2+1
+const ivec2 corners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1),
+                                  ivec2(0, 1), ivec2(1, 0), ivec2(1, 1));
+
+// no vertex data: six vertices per (stack, sector) quad, placed with the sphere's parametric equation
+//     x = cos(u) * cos(v), y = cos(u) * sin(v), z = sin(u)
+// The pole quads have two corners on the pole, so one of their triangles has no area and is dropped by the
+// rasterizer, which leaves the same triangles as the indexed smooth sphere.
+void main()
+{
+    int quad = gl_VertexID / 6;
+    ivec2 corner = ivec2(quad / sectorCount, quad % sectorCount) + corners[gl_VertexID % 6];
+
+    float stackAngle = PI / 2.0 - float(corner.x) * PI / float(stackCount);    // from pi/2 to -pi/2
+    float sectorAngle = float(corner.y) * 2.0 * PI / float(sectorCount);       // from 0 to 2pi
+    vec3 unit = vec3(cos(stackAngle) * cos(sectorAngle), cos(stackAngle) * sin(sectorAngle), sin(stackAngle));
+
+    vec4 centerRadius = texelFetch(sphereInstances, 2 * gl_InstanceID);
+    Normal = unit;
+    TexCoords = vec2(float(corner.y) / float(sectorCount), float(corner.x) / float(stackCount));
+    Color = texelFetch(sphereInstances, 2 * gl_InstanceID + 1).rgb;
+    gl_Position = projection * vec4(centerRadius.xyz + unit * centerRadius.w * radiusScale, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include "gl_ext.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary), so that a second launch
+// skips compiling and linking GLSL. A program is filed under a 64-bit FNV-1a hash of its stage sources, its
+// defines and the driver's vendor/renderer/version strings, so editing a shader or updating the driver picks
+// a different file. A binary the driver refuses anyway simply fails to load and the caller compiles from
+// source, which overwrites the stale entry.
+//
+// Without program binary support (3.3 context, no ARB_get_program_binary) every call is a no-op.
+
+#define PROGRAM_CACHE_DIRECTORY "shader_cache"
+
+// ------------------------------------------------------------------------
+inline uint64_t programCacheHash(uint64_t hash, const std::string& text)
+{
+    for (std::size_t i = 0; i < text.size(); i++)
+    {
+        hash ^= static_cast<unsigned char>(text[i]);
+        hash *= 1099511628211ull;
+    }
+    // separator, so ("ab", "c") and ("a", "bc") don't collide
+    hash ^= 0xFF;
+    hash *= 1099511628211ull;
+    return hash;
+}
+
+// cache file for a program built from these stage sources (empty stages are fine) and defines
+// ------------------------------------------------------------------------
+inline std::string programCachePath(const std::string& vertexCode, const std::string& fragmentCode,
+                                    const std::string& geometryCode = std::string(), const std::string& defines = std::string())
+{
+    uint64_t hash = 14695981039346656037ull;
+    const GLubyte* driver[3] = { glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION) };
+    for (int i = 0; i < 3; i++)
+        hash = programCacheHash(hash, driver[i] != nullptr ? reinterpret_cast<const char*>(driver[i]) : "");
+    hash = programCacheHash(hash, defines);
+    hash = programCacheHash(hash, vertexCode);
+    hash = programCacheHash(hash, fragmentCode);
+    hash = programCacheHash(hash, geometryCode);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+    return std::string(PROGRAM_CACHE_DIRECTORY) + "/" + name;
+}
+
+// try to fill an empty program object from the cache; true if it is now linked and ready to use
+// ------------------------------------------------------------------------
+inline bool loadProgramBinary(GLuint program, const std::string& path)
+{
+    if (!glExt().hasProgramBinary)
+        return false;
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+        return false;
+
+    GLenum format = 0;
+    uint32_t length = 0;
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    file.read(reinterpret_cast<char*>(&length), sizeof(length));
+    if (!file || length == 0)
+        return false;
+    std::vector<char> binary(length);
+    file.read(binary.data(), length);
+    if (!file)
+        return false;
+
+    glExt().ProgramBinary(program, format, binary.data(), static_cast<GLsizei>(length));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    return linked == GL_TRUE;
+}
+
+// call before glLinkProgram on programs that will be stored
+// ------------------------------------------------------------------------
+inline void prepareProgramBinary(GLuint program)
+{
+    if (glExt().hasProgramBinary)
+        glExt().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+// write a successfully linked program to the cache
+// ------------------------------------------------------------------------
+inline void storeProgramBinary(GLuint program, const std::string& path)
+{
+    if (!glExt().hasProgramBinary)
+        return;
+    GLint linked = GL_FALSE, length = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (linked != GL_TRUE || length <= 0)
+        return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glExt().GetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return;
+
+#ifdef _WIN32
+    _mkdir(PROGRAM_CACHE_DIRECTORY);
+#else
+    mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+#endif
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE " << path << std::endl;
+        return;
+    }
+    uint32_t size = static_cast<uint32_t>(written);
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    file.write(binary.data(), written);
+}
+#endif
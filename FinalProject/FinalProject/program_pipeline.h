@@ -0,0 +1,303 @@
+#ifndef PROGRAM_PIPELINE_H
+#define PROGRAM_PIPELINE_H
+
+#include <glad/glad.h>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include "shader.h"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+// Asynchronous program builds. request() reads the sources and issues glCompileShader/glLinkProgram without
+// asking for any status, so the driver can work on every program at once; the Shader keeps drawing with
+// whatever program it has (the flat fallback at startup, the previous version on reload) until poll() sees
+// the new one finished. With KHR_parallel_shader_compile poll() asks GL_COMPLETION_STATUS_KHR, which never
+// blocks; without it the status is only read on the frame after the build was issued, which gives drivers
+// with a compiler thread of their own the same head start.
+//
+// Programs found in the binary cache are ready immediately. Every watched source file is checked for a new
+// modification time twice a second and rebuilt through the same path, so an edit never stalls a frame and a
+// broken edit just keeps the previous program.
+//
+// A request may carry a block of #define lines (shader permutations, see shader_variants.h); it is inserted
+// after the #version line of both stages and is part of the binary cache key.
+class ProgramPipeline
+{
+public:
+    // called after a new program is swapped in: uniform block bindings, sampler units, ...
+    typedef std::function<void(Shader&)> SetupFunction;
+
+    // build the fallback program synchronously; it only needs aPos and the FrameData/ObjectData blocks
+    // ------------------------------------------------------------------------
+    void create(const char* fallbackVertexPath, const char* fallbackFragmentPath, const SetupFunction& fallbackSetup)
+    {
+        fallbackShader.reset(new Shader(fallbackVertexPath, fallbackFragmentPath));
+        if (fallbackSetup)
+            fallbackSetup(*fallbackShader);
+    }
+
+    GLuint fallbackProgram() const { return fallbackShader->ID; }
+
+    // start building target's program from these sources; target keeps its current program until it's ready
+    // ------------------------------------------------------------------------
+    void request(Shader& target, const char* vertexPath, const char* fragmentPath, const SetupFunction& setup = SetupFunction(),
+                 const std::string& defines = std::string())
+    {
+        Entry entry;
+        entry.target = &target;
+        entry.vertexPath = vertexPath;
+        entry.fragmentPath = fragmentPath;
+        entry.defines = defines;
+        entry.setup = setup;
+        entries.push_back(entry);
+        build(entries.back());
+    }
+
+    // finish whatever builds are done and start rebuilds for edited files; call once per frame
+    // ------------------------------------------------------------------------
+    void poll(float time)
+    {
+        for (std::size_t i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            if (entry.pending.program == 0)
+                continue;
+            if (glExt().hasParallelShaderCompile)
+            {
+                GLint complete = GL_FALSE;
+                glGetProgramiv(entry.pending.program, GL_COMPLETION_STATUS_KHR, &complete);
+                if (!complete)
+                    continue;
+            }
+            else if (entry.pending.issuedFrame == frame)
+                continue;
+            finish(entry);
+        }
+        frame++;
+
+        if (time - lastWatch < WATCH_INTERVAL)
+            return;
+        lastWatch = time;
+        for (std::size_t i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            if (entry.pending.program != 0)
+                continue;
+            if (modifiedTime(entry.vertexPath) != entry.vertexTime || modifiedTime(entry.fragmentPath) != entry.fragmentTime)
+            {
+                std::cout << "reloading " << entry.vertexPath << " / " << entry.fragmentPath << std::endl;
+                build(entry);
+            }
+        }
+    }
+
+    // true once the target's own program (not the fallback) is in use
+    bool ready(const Shader& target) const
+    {
+        for (std::size_t i = 0; i < entries.size(); i++)
+            if (entries[i].target == &target)
+                return entries[i].built;
+        return true;
+    }
+
+    // number of builds still in flight
+    unsigned int pendingCount() const
+    {
+        unsigned int count = 0;
+        for (std::size_t i = 0; i < entries.size(); i++)
+            if (entries[i].pending.program != 0)
+                count++;
+        return count;
+    }
+
+    // delete every program built here and the fallback, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (std::size_t i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            discard(entry.pending);
+            if (entry.built)
+                glState().deleteProgram(entry.target->ID);
+            entry.target->attach(0);
+        }
+        entries.clear();
+        if (fallbackShader)
+            glState().deleteProgram(fallbackShader->ID);
+        fallbackShader.reset();
+    }
+
+private:
+    static constexpr float WATCH_INTERVAL = 0.5f;   // seconds between modification time checks
+
+    struct Build {
+        GLuint program = 0;             // 0 = nothing in flight
+        GLuint vertex = 0;
+        GLuint fragment = 0;
+        std::string cachePath;
+        unsigned long long issuedFrame = 0;
+    };
+    struct Entry {
+        Shader* target = nullptr;
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::string defines;            // "#define ...\n" lines, empty for the plain program
+        SetupFunction setup;
+        long long vertexTime = 0;       // modification times of the sources the last build read
+        long long fragmentTime = 0;
+        bool built = false;             // target->ID is a program of ours rather than the fallback
+        Build pending;
+    };
+
+    std::unique_ptr<Shader> fallbackShader;
+    std::vector<Entry> entries;
+    unsigned long long frame = 0;
+    float lastWatch = 0.0f;
+
+    void build(Entry& entry)
+    {
+        entry.vertexTime = modifiedTime(entry.vertexPath);
+        entry.fragmentTime = modifiedTime(entry.fragmentPath);
+        std::string vertexCode, fragmentCode;
+        if (!readFile(entry.vertexPath, vertexCode) || !readFile(entry.fragmentPath, fragmentCode))
+            return;
+        vertexCode = insertDefines(vertexCode, entry.defines);
+        fragmentCode = insertDefines(fragmentCode, entry.defines);
+
+        Build& pending = entry.pending;
+        pending.cachePath = programCachePath(vertexCode, fragmentCode, std::string(), entry.defines);
+        pending.program = glCreateProgram();
+        pending.issuedFrame = frame;
+        if (loadProgramBinary(pending.program, pending.cachePath))
+        {
+            swapIn(entry);
+            return;
+        }
+
+        // issue everything, query nothing: status queries are what make the driver finish synchronously
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        pending.vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending.vertex, 1, &vShaderCode, NULL);
+        glCompileShader(pending.vertex);
+        pending.fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending.fragment, 1, &fShaderCode, NULL);
+        glCompileShader(pending.fragment);
+        glAttachShader(pending.program, pending.vertex);
+        glAttachShader(pending.program, pending.fragment);
+        prepareProgramBinary(pending.program);
+        glLinkProgram(pending.program);
+    }
+
+    // the build has completed: check it and swap it in, or report it and keep the current program
+    void finish(Entry& entry)
+    {
+        Build& pending = entry.pending;
+        GLint linked = GL_FALSE;
+        glGetProgramiv(pending.program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            printLog(pending.vertex, "VERTEX", entry.vertexPath);
+            printLog(pending.fragment, "FRAGMENT", entry.fragmentPath);
+            GLchar infoLog[1024];
+            glGetProgramInfoLog(pending.program, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            discard(pending);
+            return;
+        }
+        storeProgramBinary(pending.program, pending.cachePath);
+        swapIn(entry);
+    }
+
+    void swapIn(Entry& entry)
+    {
+        Build& pending = entry.pending;
+        if (pending.vertex != 0)
+            glDeleteShader(pending.vertex);
+        if (pending.fragment != 0)
+            glDeleteShader(pending.fragment);
+        if (entry.built)
+            glState().deleteProgram(entry.target->ID);
+        entry.target->attach(pending.program);
+        entry.built = true;
+        pending = Build();
+        if (entry.setup)
+            entry.setup(*entry.target);
+    }
+
+    static void discard(Build& pending)
+    {
+        if (pending.vertex != 0)
+            glDeleteShader(pending.vertex);
+        if (pending.fragment != 0)
+            glDeleteShader(pending.fragment);
+        if (pending.program != 0)
+            glDeleteProgram(pending.program);
+        pending = Build();
+    }
+
+    static void printLog(GLuint shader, const char* type, const std::string& path)
+    {
+        GLint success = GL_TRUE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (success)
+            return;
+        GLchar infoLog[1024];
+        glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+        std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << " (" << path << ")\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+    }
+
+    static bool readFile(const std::string& path, std::string& code)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        code = stream.str();
+        return true;
+    }
+
+    // defines must follow #version, which may itself follow comments
+    static std::string insertDefines(const std::string& code, const std::string& defines)
+    {
+        if (defines.empty())
+            return code;
+        std::size_t version = code.find("#version");
+        if (version == std::string::npos)
+            return defines + code;
+        std::size_t lineEnd = code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return code + "\n" + defines;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
+
+    static long long modifiedTime(const std::string& path)
+    {
+#ifdef _WIN32
+        struct _stat info;
+        if (_stat(path.c_str(), &info) != 0)
+            return 0;
+#else
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+#endif
+        return static_cast<long long>(info.st_mtime);
+    }
+};
+#endif
@@ -0,0 +1,389 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "mesh.h"
+#include "model.h"
+#include "gl_state.h"
+#include "occlusion_queries.h"
+#include "stream_ring.h"
+#include "transform_stage.h"
+#include "uniform_blocks.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// passes are the most significant part of the sort key, so everything of one pass is drawn before the next
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1
+};
+
+// everything needed to issue one draw call without looking back at the scene
+struct DrawPacket {
+    uint64_t key = 0;
+    Shader* shader = nullptr;
+    const Mesh* mesh = nullptr; // textured mesh (binds its own material and VAO), nullptr for raw geometry
+    GLuint vao = 0;
+    GLenum mode = GL_TRIANGLES;
+    GLsizei count = 0;
+    GLenum indexType = 0;       // 0 = glDrawArrays, otherwise the glDrawElements index type
+    GLint first = 0;            // first vertex (arrays) or byte offset into the index buffer (elements)
+    glm::mat4 model = glm::mat4(1.0f);
+    const ObjectMatrices* matrices = nullptr;  // from the transform stage; nullptr: derived from `model` in sort()
+    glm::vec4 color = glm::vec4(1.0f); // objectColor in ObjectData
+    GLintptr objectOffset = 0;  // where sort() put this packet's ObjectData in the object ring
+    // GPU occlusion: key of the object and its object-space bounds (packets without a key are never queried)
+    const void* object = nullptr;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    GLuint condition = 0;       // occlusion query the draw is conditioned on, 0 = unconditional
+};
+
+// Collects the draw packets of a frame, orders them by a 64-bit sort key and submits them in that order.
+//
+// key layout, most significant bit first:
+//   opaque:      pass(4) | program(12) | material(16) | vao(16) | depth(16)     front to back inside a state bucket
+//   transparent: pass(4) | ~depth(16)  | program(12)  | material(16) | vao(16)  strictly back to front
+// so opaque geometry changes programs and materials as rarely as possible and still gets early-Z within a
+// bucket, while blended geometry keeps the order it needs to composite correctly.
+//
+// Per-object constants (matrices, color) don't go through glUniform*: sort() writes them in draw order
+// into a StreamRing and each draw only moves the ObjectData binding to its packet's offset.
+class RenderQueue
+{
+public:
+    // start a new frame; depths are measured along the view direction and quantized over [0, farPlane]
+    // ------------------------------------------------------------------------
+    void begin(const glm::mat4& view, const glm::mat4& projection, float farPlane)
+    {
+        this->view = view;
+        this->projection = projection;
+        this->farPlane = farPlane;
+        packets.clear();
+    }
+
+    // GPU occlusion queries for packets with an object key, nullptr draws everything unconditionally
+    // ------------------------------------------------------------------------
+    void setOcclusion(OcclusionQueries* occlusion)
+    {
+        this->occlusion = occlusion;
+    }
+
+    // queue every mesh of a model
+    // ------------------------------------------------------------------------
+    void submitModel(const Model& model, Shader& shader, const glm::mat4& transform, RenderPass pass = PASS_OPAQUE)
+    {
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            packets.push_back(meshPacket(model.meshes[i], shader, transform, pass));
+    }
+
+    // queue raw geometry: indexType 0 draws count vertices with glDrawArrays starting at first; the returned
+    // packet may be adjusted (e.g. its color) until the next submit
+    // ------------------------------------------------------------------------
+    DrawPacket& submit(Shader& shader, GLuint vao, GLenum mode, GLsizei count, GLenum indexType, const glm::mat4& transform,
+                       RenderPass pass = PASS_OPAQUE, GLint first = 0)
+    {
+        packets.push_back(geometryPacket(shader, vao, mode, count, indexType, transform, pass, first));
+        return packets.back();
+    }
+
+    // queue packets built elsewhere (e.g. per-job lists from worker threads), in list order
+    // ------------------------------------------------------------------------
+    void append(const std::vector<DrawPacket>& list)
+    {
+        packets.insert(packets.end(), list.begin(), list.end());
+    }
+
+    // build the packet of one mesh without queueing it; const and safe to call from several threads
+    // ------------------------------------------------------------------------
+    DrawPacket meshPacket(const Mesh& mesh, Shader& shader, const glm::mat4& transform, RenderPass pass = PASS_OPAQUE) const
+    {
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.mesh = &mesh;
+        packet.vao = mesh.VAO;
+        packet.count = static_cast<GLsizei>(mesh.indices.size());
+        packet.indexType = GL_UNSIGNED_INT;
+        packet.model = transform;
+        packet.object = &mesh;
+        packet.boundsMin = mesh.boundsMin;
+        packet.boundsMax = mesh.boundsMax;
+        // atlas materials sort by their array so meshes that only differ by layer end up adjacent
+        GLuint material = mesh.material.diffuseArray;
+        if (material == 0 && !mesh.textures.empty())
+            material = mesh.textures[0].id;
+        packet.key = makeKey(pass, shader.ID, material, mesh.VAO, quantizeDepth(transform));
+        return packet;
+    }
+
+    // build the packet of raw geometry without queueing it; const and safe to call from several threads
+    // ------------------------------------------------------------------------
+    DrawPacket geometryPacket(Shader& shader, GLuint vao, GLenum mode, GLsizei count, GLenum indexType, const glm::mat4& transform,
+                              RenderPass pass = PASS_OPAQUE, GLint first = 0) const
+    {
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.vao = vao;
+        packet.mode = mode;
+        packet.count = count;
+        packet.indexType = indexType;
+        packet.first = first;
+        packet.model = transform;
+        packet.key = makeKey(pass, shader.ID, 0, vao, quantizeDepth(transform));
+        return packet;
+    }
+
+    // order packets by key (stable LSD radix sort, bytes that are equal in every key are skipped), stream
+    // their ObjectData into the ring in that order and set aside the packets that were occluded last frame
+    // ------------------------------------------------------------------------
+    void sort()
+    {
+        std::size_t n = packets.size();
+        keys.resize(n);
+        deferred.clear();
+        if (n == 0)
+            return;
+        sortKeys(n);
+        uploadObjects(n);
+        if (occlusion != nullptr)
+            splitOccluded();
+    }
+
+    // issue the sorted packets that were visible last frame; per-frame blocks (FrameData, LightData) must be
+    // uploaded beforehand
+    // ------------------------------------------------------------------------
+    void execute() const
+    {
+        for (std::size_t i = 0; i < keys.size(); i++)
+            draw(packets[keys[i].index]);
+    }
+
+    // depth-only pass over the same packets as execute(), with one position-only program for all of them;
+    // no textures or materials are bound and color writes are masked off meanwhile. Packets of a fading LOD
+    // (color.a != 1) take `ditheredShader` instead, so the discard it needs stays out of everyone else's
+    // program and keeps early depth tests on for them
+    // ------------------------------------------------------------------------
+    void executeDepthOnly(const Shader& depthShader, const Shader* ditheredShader = nullptr) const
+    {
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (std::size_t i = 0; i < keys.size(); i++)
+        {
+            const DrawPacket& packet = packets[keys[i].index];
+            bool dithered = ditheredShader != nullptr && packet.color.a != 1.0f;
+            glState().useProgram(dithered ? ditheredShader->ID : depthShader.ID);
+            glState().bindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UBO_BINDING, objects.id(), packet.objectOffset, sizeof(ObjectUniforms));
+            drawGeometry(packet);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    }
+
+    // after execute(): query the boxes of every keyed packet against the depth buffer drawn so far, then draw
+    // the packets occluded last frame, each conditioned on its query
+    // ------------------------------------------------------------------------
+    void executeOccluded()
+    {
+        if (occlusion == nullptr)
+            return;
+        occlusion->beginProxies();
+        for (std::size_t i = 0; i < deferred.size(); i++)
+        {
+            DrawPacket& packet = packets[deferred[i].index];
+            packet.condition = occlusion->query(packet.object, packet.boundsMin, packet.boundsMax, packet.model);
+        }
+        // visible packets are queried too, their results decide next frame's split
+        for (std::size_t i = 0; i < keys.size(); i++)
+        {
+            const DrawPacket& packet = packets[keys[i].index];
+            if (packet.object != nullptr)
+                occlusion->query(packet.object, packet.boundsMin, packet.boundsMax, packet.model);
+        }
+        occlusion->endProxies();
+
+        for (std::size_t i = 0; i < deferred.size(); i++)
+            draw(packets[deferred[i].index]);
+    }
+
+    // number of packets for execute(), those occluded last frame are not counted
+    std::size_t size() const { return keys.size(); }
+    // i-th of those packets in sorted order, valid after sort()
+    const DrawPacket& sorted(std::size_t i) const { return packets[keys[i].index]; }
+
+    // the packet's matrices: the transform stage's if it has them, computed once here otherwise
+    // ------------------------------------------------------------------------
+    ObjectMatrices objectMatrices(const DrawPacket& packet) const
+    {
+        if (packet.matrices != nullptr)
+            return *packet.matrices;
+        ObjectMatrices matrices;
+        matrices.world = packet.model;
+        matrices.modelView = view * packet.model;
+        matrices.modelViewProjection = projection * matrices.modelView;
+        glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(matrices.modelView)));
+        for (int c = 0; c < 3; c++)
+            matrices.normal[c] = glm::vec4(normal[c], 0.0f);
+        return matrices;
+    }
+
+    // issue a single packet on the classic one-call-per-draw path
+    // ------------------------------------------------------------------------
+    void draw(const DrawPacket& packet) const
+    {
+        glState().useProgram(packet.shader->ID);
+        glState().bindBufferRange(GL_UNIFORM_BUFFER, OBJECT_UBO_BINDING, objects.id(), packet.objectOffset, sizeof(ObjectUniforms));
+        // NO_WAIT: if the query hasn't finished the GPU draws rather than stalls
+        if (packet.condition != 0)
+            glBeginConditionalRender(packet.condition, GL_QUERY_NO_WAIT);
+        if (packet.mesh != nullptr)
+        {
+            // Mesh::Draw binds its textures and VAO through the state cache
+            packet.mesh->Draw(*packet.shader);
+        }
+        else
+            drawGeometry(packet);
+        if (packet.condition != 0)
+            glEndConditionalRender();
+    }
+
+    // delete the object ring, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        objects.release();
+        objectStride = 0;
+    }
+
+    // compose a sort key, see the class comment for the layout
+    // ------------------------------------------------------------------------
+    static uint64_t makeKey(RenderPass pass, GLuint program, GLuint material, GLuint vao, uint16_t depth)
+    {
+        uint64_t p = static_cast<uint64_t>(pass) & 0xF;
+        uint64_t prog = static_cast<uint64_t>(program) & 0xFFF;
+        uint64_t mat = static_cast<uint64_t>(material) & 0xFFFF;
+        uint64_t v = static_cast<uint64_t>(vao) & 0xFFFF;
+        if (pass == PASS_TRANSPARENT)
+        {
+            uint64_t backToFront = static_cast<uint64_t>(static_cast<uint16_t>(~depth));
+            return (p << 60) | (backToFront << 44) | (prog << 32) | (mat << 16) | v;
+        }
+        return (p << 60) | (prog << 48) | (mat << 32) | (v << 16) | depth;
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    float farPlane = 100.0f;
+    OcclusionQueries* occlusion = nullptr;
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> keys;
+    std::vector<SortEntry> deferred;    // sorted packets occluded last frame, drawn by executeOccluded()
+    std::vector<SortEntry> scratch;
+
+    StreamRing objects;
+    GLsizeiptr objectStride = 0;    // sizeof(ObjectUniforms) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+
+    void sortKeys(std::size_t n)
+    {
+        scratch.resize(n);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            keys[i].key = packets[i].key;
+            keys[i].index = static_cast<uint32_t>(i);
+        }
+
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            std::size_t histogram[256] = { 0 };
+            for (std::size_t i = 0; i < n; i++)
+                histogram[(keys[i].key >> shift) & 0xFF]++;
+            // every key has the same byte here, the pass would not move anything
+            if (histogram[(keys[0].key >> shift) & 0xFF] == n)
+                continue;
+
+            std::size_t offset = 0;
+            for (unsigned int b = 0; b < 256; b++)
+            {
+                std::size_t count = histogram[b];
+                histogram[b] = offset;
+                offset += count;
+            }
+            for (std::size_t i = 0; i < n; i++)
+                scratch[histogram[(keys[i].key >> shift) & 0xFF]++] = keys[i];
+            keys.swap(scratch);
+        }
+    }
+
+    // one ObjectData per packet, laid out in draw order so consecutive draws read neighbouring memory
+    void uploadObjects(std::size_t n)
+    {
+        if (objectStride == 0)
+        {
+            GLint alignment = 256;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            objectStride = StreamRing::align(sizeof(ObjectUniforms), alignment);
+            objects.create(objectStride * static_cast<GLsizeiptr>(n));
+        }
+
+        unsigned char* out = objects.begin(objectStride * static_cast<GLsizeiptr>(n));
+        for (std::size_t i = 0; i < n; i++)
+        {
+            const DrawPacket& packet = packets[keys[i].index];
+            ObjectMatrices matrices = objectMatrices(packet);
+            ObjectUniforms data;
+            data.model = matrices.world;
+            data.modelView = matrices.modelView;
+            data.modelViewProjection = matrices.modelViewProjection;
+            for (int c = 0; c < 3; c++)
+                data.normalMatrix[c] = matrices.normal[c];
+            data.color = packet.color;
+            std::memcpy(out + i * objectStride, &data, sizeof(ObjectUniforms));
+        }
+        GLintptr base = objects.end();
+        for (std::size_t i = 0; i < n; i++)
+            packets[keys[i].index].objectOffset = base + static_cast<GLintptr>(i * objectStride);
+    }
+
+    // the packet's VAO and draw call, whatever program is bound (mesh packets carry their VAO and index count too)
+    static void drawGeometry(const DrawPacket& packet)
+    {
+        glState().bindVertexArray(packet.vao);
+        if (packet.indexType == 0)
+            glDrawArrays(packet.mode, packet.first, packet.count);
+        else
+            glDrawElements(packet.mode, packet.count, packet.indexType, (void*)(intptr_t)packet.first);
+    }
+
+    // stable split of the sorted keys into last frame's visible and occluded packets
+    void splitOccluded()
+    {
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < keys.size(); i++)
+        {
+            const DrawPacket& packet = packets[keys[i].index];
+            if (packet.object != nullptr && !occlusion->wasVisible(packet.object))
+                deferred.push_back(keys[i]);
+            else
+                keys[kept++] = keys[i];
+        }
+        keys.resize(kept);
+    }
+
+    // view-space distance of the object's origin, mapped to 16 bits
+    uint16_t quantizeDepth(const glm::mat4& transform) const
+    {
+        float depth = -(view * transform[3]).z / farPlane;
+        depth = glm::clamp(depth, 0.0f, 1.0f);
+        return static_cast<uint16_t>(depth * 65535.0f);
+    }
+};
+#endif
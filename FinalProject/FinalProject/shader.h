@@ -4,18 +4,55 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "gl_state.h"
+#include "program_cache.h"
+
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+// 32-bit FNV-1a of a uniform, block or attribute name. constexpr, so handles built from string literals cost
+// nothing at run time; hash continues a previous one (e.g. "texture_diffuse" then "1").
+constexpr std::uint32_t shaderHash(const char* text, std::uint32_t hash = 2166136261u)
+{
+    while (*text != '\0')
+        hash = (hash ^ static_cast<unsigned char>(*text++)) * 16777619u;
+    return hash;
+}
+
+// A uniform name hashed once, typed with the value it takes. Keep them as (function) statics next to the
+// draw code: Shader::set() then costs one table probe and, if the value changed, one glUniform* call.
+template<typename T>
+struct Uniform
+{
+    std::uint32_t hash;
+    constexpr explicit Uniform(const char* name) : hash(shaderHash(name)) {}
+    constexpr explicit Uniform(std::uint32_t hash) : hash(hash) {}
+};
 
+// One shader class for every program in the project (vertex/fragment with an optional geometry stage, or a
+// program linked elsewhere). After link the program is reflected: its active uniforms, uniform blocks and
+// vertex attributes go into flat open-addressing tables keyed by the name hashes, so setting a uniform never
+// builds a string or asks the driver for a location. Every uniform also keeps a shadow of the last value
+// uploaded through this Shader; setting the same value again is skipped. glUniform* writes to the bound
+// program, so call use() first as before.
+//
+// Shadows belong to the Shader, not the program: two Shaders wrapping the same program (ShaderVariants
+// placeholders on the fallback) must not set different values for the same uniform.
 class Shader
 {
 public:
     unsigned int ID;
+    // wrap a program built elsewhere (ProgramPipeline swaps ID once an asynchronous build is ready)
+    // ------------------------------------------------------------------------
+    explicit Shader(unsigned int program) : ID(0) { attach(program); }
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) : ID(0)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -57,9 +94,17 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
+        // 2. reuse the linked program from the binary cache if these exact sources were built before
+        std::string cachePath = programCachePath(vertexCode, fragmentCode, geometryCode);
+        GLuint program = glCreateProgram();
+        if (loadProgramBinary(program, cachePath))
+        {
+            attach(program);
+            return;
+        }
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
+        // 3. compile shaders
         unsigned int vertex, fragment;
         // vertex shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
@@ -82,86 +127,263 @@ public:
             checkCompileErrors(geometry, "GEOMETRY");
         }
         // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
         if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+            glAttachShader(program, geometry);
+        prepareProgramBinary(program);
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        storeProgramBinary(program, cachePath);
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
         if (geometryPath != nullptr)
             glDeleteShader(geometry);
-
+        attach(program);
+    }
+    // switch to another program (a finished rebuild, 0 when it's deleted): reflect it and forget the shadows
+    // ------------------------------------------------------------------------
+    void attach(unsigned int program)
+    {
+        ID = program;
+        reflect();
     }
     // activate the shader
     // ------------------------------------------------------------------------
-    void use()
+    void use() const
     {
-        glUseProgram(ID);
+        glState().useProgram(ID);
+    }
+    // reflected locations; -1 (GL_INVALID_INDEX for blocks) when the program has no such active name
+    // ------------------------------------------------------------------------
+    GLint uniformLocation(const char* name) const
+    {
+        const Slot* slot = find(uniforms, shaderHash(name));
+        return slot != nullptr ? slot->location : -1;
+    }
+    GLuint blockIndex(const char* name) const
+    {
+        const Slot* slot = find(blocks, shaderHash(name));
+        return slot != nullptr ? static_cast<GLuint>(slot->location) : GL_INVALID_INDEX;
+    }
+    GLint attributeLocation(const char* name) const
+    {
+        const Slot* slot = find(attributes, shaderHash(name));
+        return slot != nullptr ? slot->location : -1;
+    }
+    // typed uniform handles
+    // ------------------------------------------------------------------------
+    template<typename T>
+    void set(const Uniform<T>& uniform, const T& value) const
+    {
+        upload(uniform.hash, value);
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string& name, bool value) const
+    void setBool(const char* name, bool value) const
+    {
+        upload(shaderHash(name), static_cast<int>(value));
+    }
+    // ------------------------------------------------------------------------
+    void setInt(const char* name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        upload(shaderHash(name), value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setFloat(const char* name, float value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        upload(shaderHash(name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setIVec2(const char* name, int x, int y) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        upload(shaderHash(name), glm::ivec2(x, y));
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(const char* name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        upload(shaderHash(name), value);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(const char* name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        upload(shaderHash(name), glm::vec2(x, y));
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(const char* name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        upload(shaderHash(name), value);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(const char* name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        upload(shaderHash(name), glm::vec3(x, y, z));
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(const char* name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        upload(shaderHash(name), value);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(const char* name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        upload(shaderHash(name), glm::vec4(x, y, z, w));
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(const char* name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        upload(shaderHash(name), mat);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(const char* name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        upload(shaderHash(name), mat);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(const char* name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        upload(shaderHash(name), mat);
     }
 
 private:
+    // one table entry; location < 0 marks an empty slot. value is the shadow, valid once known is set
+    struct Slot {
+        std::uint32_t hash = 0;
+        GLint location = -1;
+        bool known = false;
+        unsigned char value[sizeof(glm::mat4)];
+    };
+
+    // power-of-two sized, at most half full, linear probing. mutable: setting a uniform updates its shadow
+    mutable std::vector<Slot> uniforms;
+    std::vector<Slot> blocks;
+    std::vector<Slot> attributes;
+
+    template<typename T>
+    void upload(std::uint32_t hash, const T& value) const
+    {
+        static_assert(sizeof(T) <= sizeof(Slot::value), "uniform value doesn't fit the shadow");
+        Slot* slot = const_cast<Slot*>(find(uniforms, hash));
+        if (slot == nullptr)
+            return;
+        if (slot->known && std::memcmp(slot->value, &value, sizeof(T)) == 0)
+            return;
+        std::memcpy(slot->value, &value, sizeof(T));
+        slot->known = true;
+        uploadValue(slot->location, value);
+    }
+
+    static void uploadValue(GLint location, int value) { glUniform1i(location, value); }
+    static void uploadValue(GLint location, float value) { glUniform1f(location, value); }
+    static void uploadValue(GLint location, const glm::ivec2& value) { glUniform2iv(location, 1, &value[0]); }
+    static void uploadValue(GLint location, const glm::vec2& value) { glUniform2fv(location, 1, &value[0]); }
+    static void uploadValue(GLint location, const glm::vec3& value) { glUniform3fv(location, 1, &value[0]); }
+    static void uploadValue(GLint location, const glm::vec4& value) { glUniform4fv(location, 1, &value[0]); }
+    static void uploadValue(GLint location, const glm::mat2& mat) { glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]); }
+    static void uploadValue(GLint location, const glm::mat3& mat) { glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]); }
+    static void uploadValue(GLint location, const glm::mat4& mat) { glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]); }
+
+    static const Slot* find(const std::vector<Slot>& table, std::uint32_t hash)
+    {
+        if (table.empty())
+            return nullptr;
+        std::size_t mask = table.size() - 1;
+        for (std::size_t i = hash & mask; table[i].location >= 0; i = (i + 1) & mask)
+            if (table[i].hash == hash)
+                return &table[i];
+        return nullptr;
+    }
+
+    static void insert(std::vector<Slot>& table, const std::string& name, GLint location)
+    {
+        std::uint32_t hash = shaderHash(name.c_str());
+        std::size_t mask = table.size() - 1;
+        std::size_t i = hash & mask;
+        for (; table[i].location >= 0; i = (i + 1) & mask)
+            if (table[i].hash == hash)
+            {
+                std::cout << "ERROR::SHADER::NAME_HASH_COLLISION: " << name << std::endl;
+                return;
+            }
+        table[i].hash = hash;
+        table[i].location = location;
+    }
+
+    static void resizeTable(std::vector<Slot>& table, GLint names)
+    {
+        std::size_t size = 8;
+        while (size < static_cast<std::size_t>(names) * 2)
+            size *= 2;
+        table.assign(size, Slot());
+    }
+
+    // fill the tables from the driver's view of the linked program; the only time names meet GL
+    void reflect()
+    {
+        uniforms.clear();
+        blocks.clear();
+        attributes.clear();
+        if (ID == 0)
+            return;
+
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(static_cast<std::size_t>(maxLength) + 16);
+        std::vector<std::string> names;
+        std::vector<GLint> locations;
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), NULL, &size, &type, name.data());
+            GLint location = glGetUniformLocation(ID, name.data());
+            if (location < 0)
+                continue;   // member of a uniform block
+            std::string uniform = name.data();
+            names.push_back(uniform);
+            locations.push_back(location);
+            // arrays are reported as "name[0]": also file "name" and every element
+            std::size_t bracket = uniform.rfind("[0]");
+            if (bracket == std::string::npos || bracket + 3 != uniform.size())
+                continue;
+            std::string base = uniform.substr(0, bracket);
+            names.push_back(base);
+            locations.push_back(location);
+            for (GLint element = 1; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                names.push_back(elementName);
+                locations.push_back(glGetUniformLocation(ID, elementName.c_str()));
+            }
+        }
+        resizeTable(uniforms, static_cast<GLint>(names.size()));
+        for (std::size_t i = 0; i < names.size(); i++)
+            insert(uniforms, names[i], locations[i]);
+
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.assign(static_cast<std::size_t>(maxLength) + 1, '\0');
+        resizeTable(blocks, count);
+        for (GLint i = 0; i < count; i++)
+        {
+            glGetActiveUniformBlockName(ID, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), NULL, name.data());
+            insert(blocks, name.data(), i);
+        }
+
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.assign(static_cast<std::size_t>(maxLength) + 1, '\0');
+        resizeTable(attributes, count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveAttrib(ID, static_cast<GLuint>(i), static_cast<GLsizei>(name.size()), NULL, &size, &type, name.data());
+            GLint location = glGetAttribLocation(ID, name.data());
+            if (location >= 0)      // built-ins such as gl_VertexID have none
+                insert(attributes, name.data(), location);
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,108 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "program_pipeline.h"
+#include "shader.h"
+#include "uniform_blocks.h"
+
+#include <map>
+#include <memory>
+#include <string>
+
+// feature flags of a permutation; each one becomes a #define of the same name in both stages
+enum PermutationFeature {
+    PERMUTATION_SPECULAR = 1 << 0,
+    PERMUTATION_CLUSTERED = 1 << 1,     // clustered point lights (light_clusters.h)
+    PERMUTATION_SHADOWED = 1 << 2,      // sun shadow cascades (shadow_maps.h)
+    PERMUTATION_LOD_FADE = 1 << 3,      // dithered LOD crossfade (GeometryLod in geometry_registry.h)
+};
+
+// Compile-time specializations of one vertex/fragment pair. A permutation key holds a light count and a set of
+// PermutationFeature flags; its program is built from the same sources with
+//
+//     #define PERMUTATION 1
+//     #define LIGHT_COUNT <n>
+//     #define SPECULAR 1          (per flag)
+//
+// so the shader can turn the light loop into a constant-bound (unrolled) one and compile out the features a
+// draw doesn't use. The generic program, built without any defines, loops over the uniform light count with
+// every feature on; it is requested up front and drawn with while a permutation is still compiling.
+//
+// Permutations are built on first use through the ProgramPipeline, so they compile in the background, land in
+// the binary cache under their own defines and reload with their sources.
+class ShaderVariants
+{
+public:
+    static const unsigned int GENERIC = 0xFFFFFFFFu;
+
+    // ------------------------------------------------------------------------
+    void create(ProgramPipeline& pipeline, const char* vertexPath, const char* fragmentPath,
+                const ProgramPipeline::SetupFunction& setup)
+    {
+        this->pipeline = &pipeline;
+        this->vertexPath = vertexPath;
+        this->fragmentPath = fragmentPath;
+        this->setup = setup;
+        generic.reset(new Shader(pipeline.fallbackProgram()));
+        pipeline.request(*generic, vertexPath, fragmentPath, setup);
+    }
+
+    static unsigned int key(int lightCount, unsigned int features)
+    {
+        if (lightCount < 0)
+            lightCount = 0;
+        if (lightCount > MAX_POINT_LIGHTS)
+            lightCount = MAX_POINT_LIGHTS;
+        return static_cast<unsigned int>(lightCount) | (features << LIGHT_COUNT_BITS);
+    }
+
+    // the permutation for this key if it's built, the generic program otherwise; the first call for a key
+    // starts its build (GL thread only)
+    // ------------------------------------------------------------------------
+    Shader& select(unsigned int permutation)
+    {
+        if (permutation == GENERIC)
+            return *generic;
+        std::map<unsigned int, std::unique_ptr<Shader> >::iterator it = variants.find(permutation);
+        if (it == variants.end())
+        {
+            Shader* variant = new Shader(pipeline->fallbackProgram());
+            variants[permutation].reset(variant);
+            pipeline->request(*variant, vertexPath.c_str(), fragmentPath.c_str(), setup, defines(permutation));
+            return *generic;
+        }
+        return pipeline->ready(*it->second) ? *it->second : *generic;
+    }
+
+    Shader& genericShader() { return *generic; }
+
+    // permutations requested so far, built or not
+    std::size_t size() const { return variants.size(); }
+
+private:
+    enum { LIGHT_COUNT_BITS = 4 };  // enough for MAX_POINT_LIGHTS
+
+    ProgramPipeline* pipeline = nullptr;
+    std::string vertexPath;
+    std::string fragmentPath;
+    ProgramPipeline::SetupFunction setup;
+    std::unique_ptr<Shader> generic;
+    std::map<unsigned int, std::unique_ptr<Shader> > variants;  // Shaders stay put, the pipeline points at them
+
+    static std::string defines(unsigned int permutation)
+    {
+        std::string text = "#define PERMUTATION 1\n";
+        text += "#define LIGHT_COUNT " + std::to_string(permutation & ((1u << LIGHT_COUNT_BITS) - 1)) + "\n";
+        unsigned int features = permutation >> LIGHT_COUNT_BITS;
+        if (features & PERMUTATION_SPECULAR)
+            text += "#define SPECULAR 1\n";
+        if (features & PERMUTATION_CLUSTERED)
+            text += "#define CLUSTERED 1\n";
+        if (features & PERMUTATION_SHADOWED)
+            text += "#define SHADOWED 1\n";
+        if (features & PERMUTATION_LOD_FADE)
+            text += "#define LOD_FADE 1\n";
+        return text;
+    }
+};
+#endif
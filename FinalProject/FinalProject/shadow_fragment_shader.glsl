@@ -0,0 +1,6 @@
+#version 330 core
+
+// shadow casters (ShadowMapper in shadow_maps.h): depth only, every level of a fading LOD object is solid here
+void main()
+{
+}
\ No newline at end of file
@@ -0,0 +1,346 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "draw_list_builder.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "uniform_blocks.h"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// texture unit of the cascade array, after the G-buffer units
+#define SHADOW_MAP_UNIT 10
+
+// Cascaded shadow maps for the directional sun. The view frustum up to shadowDistance is split into
+// SHADOW_CASCADES slices (practical split scheme); each cascade is an orthographic light view around the
+// bounding sphere of its slice, so its size doesn't change as the camera turns, and its center is snapped to
+// whole texels, so a moving camera doesn't make shadow edges crawl.
+//
+// The distant cascades (from FIRST_CACHED_CASCADE on) keep their static casters in a second depth array:
+// such a cascade is fitted with a margin and only re-centered once its slice leaves the margin, so its light
+// matrix, and with it the cached depth, stays valid for many frames. Static casters are redrawn only when the
+// cascade moves, the sun turns or invalidateStatic() is called; every frame the cached depth is copied into
+// the sampled array and the dynamic casters are drawn on top (nothing at all when neither changed). The near
+// cascades are small and refit every frame, they draw both kinds of casters directly.
+//
+// Casters are drawn position-only with one program (model and light matrix as uniforms), depth clamped so
+// casters in front of a cascade's near plane still cast.
+class ShadowMapper
+{
+public:
+    enum {
+        CASCADES = SHADOW_CASCADES,
+        FIRST_CACHED_CASCADE = 2
+    };
+
+    struct Stats {
+        unsigned int staticRedraws = 0;     // cached cascades whose static casters were drawn this frame
+        unsigned int casterDraws = 0;       // caster draw calls this frame, all cascades
+    };
+
+    float shadowDistance = 50.0f;           // view depth covered by the last cascade
+
+    // depth arrays, framebuffers and the caster program
+    // ------------------------------------------------------------------------
+    void create(int resolution = 2048)
+    {
+        this->resolution = resolution;
+        block.reset(new UniformBlock<ShadowUniforms>(SHADOW_UBO_BINDING));
+        casterShader.reset(new Shader("shadow_vertex_shader.glsl", "shadow_fragment_shader.glsl"));
+
+        cascadeMaps = createArray();
+        staticMaps = createArray();
+        // the sampled array compares against the reference depth: sampler2DArrayShadow with 2x2 PCF per tap
+        glState().bindTexture(SHADOW_MAP_UNIT, GL_TEXTURE_2D_ARRAY, cascadeMaps);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        // depth only: no color buffers to draw to or read from
+        glGenFramebuffers(2, framebuffers);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeMaps, 0, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::FRAMEBUFFER:: shadow cascade framebuffer is not complete!" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // delete the arrays, framebuffers, block and program, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        if (framebuffers[0] != 0)
+        {
+            glDeleteFramebuffers(2, framebuffers);
+            framebuffers[0] = framebuffers[1] = 0;
+        }
+        glState().deleteTexture(cascadeMaps);
+        glState().deleteTexture(staticMaps);
+        cascadeMaps = staticMaps = 0;
+        if (casterShader)
+            glState().deleteProgram(casterShader->ID);
+        casterShader.reset();
+        if (block)
+            block->release();
+        block.reset();
+    }
+
+    // static casters moved, appeared or went away: redraw them into every cached cascade
+    void invalidateStatic()
+    {
+        for (int c = 0; c < CASCADES; c++)
+            cascades[c].staticValid = false;
+    }
+
+    // fit the cascades to the camera's frustum and upload ShadowData; `shadowed` says whether render() runs
+    // this frame (without it the sun still lights the scene, unshadowed). toSun is a world space direction
+    // ------------------------------------------------------------------------
+    void update(const Camera& camera, const glm::mat4& view, float fovY, float aspect, float nearPlane, float farPlane,
+                const glm::vec3& toSun, const glm::vec3& sunColor, bool shadowed)
+    {
+        glm::vec3 direction = glm::normalize(toSun);
+        if (direction != sunDirection)
+        {
+            sunDirection = direction;
+            invalidateStatic();
+        }
+        // rotation only: light space is fixed for a given sun, so cascade centers can be snapped in it
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        lightView = glm::lookAt(glm::vec3(0.0f), -direction, up);
+
+        float tanY = std::tan(fovY * 0.5f);
+        float tanX = tanY * aspect;
+        float k2 = tanX * tanX + tanY * tanY;
+        float farthest = glm::min(farPlane, shadowDistance);
+        float sliceNear = nearPlane;
+        glm::mat4 inverseView = glm::inverse(view);
+        // [-1,1] clip space to [0,1] texture space
+        const glm::mat4 bias = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)), glm::vec3(0.5f));
+        for (int c = 0; c < CASCADES; c++)
+        {
+            // practical split: mostly logarithmic, blended with uniform so the first cascade isn't tiny
+            float t = float(c + 1) / float(CASCADES);
+            float sliceFar = SPLIT_LAMBDA * nearPlane * std::pow(farthest / nearPlane, t) +
+                             (1.0f - SPLIT_LAMBDA) * (nearPlane + (farthest - nearPlane) * t);
+            fitCascade(cascades[c], c >= FIRST_CACHED_CASCADE, camera, sliceNear, sliceFar, k2);
+            block->data.cascadeMatrices[c] = bias * cascades[c].viewProjection * inverseView;
+            block->data.cascadeSplits[c] = sliceFar;
+            block->data.cascadeTexels[c] = 2.0f * cascades[c].extent / float(resolution);
+            sliceNear = sliceFar;
+        }
+        block->data.sunDirection = glm::vec4(glm::normalize(glm::vec3(view * glm::vec4(direction, 0.0f))), 0.0f);
+        block->data.sunColor = glm::vec4(sunColor, shadowed ? 1.0f : 0.0f);
+        block->upload();
+    }
+
+    // draw the casters into the cascades; viewport is the size to restore for the default framebuffer
+    // ------------------------------------------------------------------------
+    void render(const std::vector<SceneObject>& objects, const DrawListBuilder& transforms, int viewportWidth, int viewportHeight)
+    {
+        static const Uniform<glm::mat4> lightViewProjection("lightViewProjection");
+        current = Stats();
+
+        glViewport(0, 0, resolution, resolution);
+        glState().enable(GL_DEPTH_TEST);
+        glState().enable(GL_DEPTH_CLAMP);
+        glState().enable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.5f, 4.0f);
+        casterShader->use();
+        for (int c = 0; c < CASCADES; c++)
+        {
+            Cascade& cascade = cascades[c];
+            casterShader->set(lightViewProjection, cascade.viewProjection);
+            if (c < FIRST_CACHED_CASCADE)
+            {
+                attach(GL_FRAMEBUFFER, framebuffers[0], cascadeMaps, c);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawCasters(objects, transforms, cascade, SHADOW_STATIC, true);
+                drawCasters(objects, transforms, cascade, SHADOW_DYNAMIC, true);
+                continue;
+            }
+
+            if (!cascade.staticValid)
+            {
+                attach(GL_FRAMEBUFFER, framebuffers[0], staticMaps, c);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                drawCasters(objects, transforms, cascade, SHADOW_STATIC, true);
+                cascade.staticValid = true;
+                cascade.holdsStatic = false;
+                current.staticRedraws++;
+            }
+            unsigned int dynamicCasters = drawCasters(objects, transforms, cascade, SHADOW_DYNAMIC, false);
+            // the sampled layer is already exactly the cached static depth
+            if (cascade.holdsStatic && dynamicCasters == 0)
+                continue;
+
+            // composite: cached static depth first, this frame's dynamic casters on top
+            attach(GL_READ_FRAMEBUFFER, framebuffers[1], staticMaps, c);
+            attach(GL_DRAW_FRAMEBUFFER, framebuffers[0], cascadeMaps, c);
+            glBlitFramebuffer(0, 0, resolution, resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+            drawCasters(objects, transforms, cascade, SHADOW_DYNAMIC, true);
+            cascade.holdsStatic = dynamicCasters == 0;
+        }
+        glState().disable(GL_POLYGON_OFFSET_FILL);
+        glState().disable(GL_DEPTH_CLAMP);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
+
+    Stats stats() const { return current; }
+
+private:
+    static constexpr float SPLIT_LAMBDA = 0.75f;    // 0 uniform splits, 1 logarithmic
+    static constexpr float CACHE_MARGIN = 0.5f;     // cached cascades cover this much more than their slice
+
+    struct Cascade {
+        glm::vec3 center = glm::vec3(0.0f);         // light space, snapped to texels
+        float extent = 0.0f;                        // half size of the ortho box
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+        bool staticValid = false;                   // cached cascades: the static array layer matches viewProjection
+        bool holdsStatic = false;                   // cached cascades: the sampled layer is a plain copy of it
+    };
+
+    int resolution = 2048;
+    GLuint cascadeMaps = 0;             // sampled, SHADOW_CASCADES layers
+    GLuint staticMaps = 0;              // static casters of the cached cascades
+    GLuint framebuffers[2] = { 0, 0 };  // draw and blit-read target
+    std::unique_ptr<Shader> casterShader;
+    std::unique_ptr<UniformBlock<ShadowUniforms> > block;
+    Cascade cascades[CASCADES];
+    glm::vec3 sunDirection = glm::vec3(0.0f);
+    glm::mat4 lightView = glm::mat4(1.0f);
+    Stats current;
+
+    GLuint createArray()
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, CASCADES, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return texture;
+    }
+
+    static void attach(GLenum target, GLuint framebuffer, GLuint array, int layer)
+    {
+        glBindFramebuffer(target, framebuffer);
+        glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, array, 0, layer);
+    }
+
+    // bounding sphere of the view slice [sliceNear, sliceFar]: independent of the camera's rotation, so the
+    // cascade only changes size when the projection does
+    void fitCascade(Cascade& cascade, bool cached, const Camera& camera, float sliceNear, float sliceFar, float k2)
+    {
+        float centerDepth, radius;
+        if (k2 >= (sliceFar - sliceNear) / (sliceFar + sliceNear))
+        {
+            centerDepth = sliceFar;
+            radius = sliceFar * std::sqrt(k2);
+        }
+        else
+        {
+            centerDepth = 0.5f * (sliceFar + sliceNear) * (1.0f + k2);
+            radius = 0.5f * std::sqrt((sliceFar - sliceNear) * (sliceFar - sliceNear) +
+                                      2.0f * (sliceFar * sliceFar + sliceNear * sliceNear) * k2 +
+                                      (sliceFar + sliceNear) * (sliceFar + sliceNear) * k2 * k2);
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;    // float noise must not resize (and invalidate) a cascade
+        glm::vec3 center = glm::vec3(lightView * glm::vec4(camera.Position + camera.Front * centerDepth, 1.0f));
+
+        float extent = cached ? radius * (1.0f + CACHE_MARGIN) : radius;
+        if (cached && cascade.staticValid && extent == cascade.extent)
+        {
+            glm::vec3 offset = glm::abs(center - cascade.center);
+            float slack = extent - radius;
+            if (offset.x <= slack && offset.y <= slack && offset.z <= slack)
+                return;     // the slice is still inside the cached box: same matrix, cached depth stays valid
+        }
+
+        float texel = 2.0f * extent / float(resolution);
+        cascade.center = glm::floor(center / texel) * texel;
+        cascade.extent = extent;
+        // light space looks down -z: the box spans view distances -(z + extent) .. -(z - extent)
+        glm::mat4 projection = glm::ortho(cascade.center.x - extent, cascade.center.x + extent,
+                                          cascade.center.y - extent, cascade.center.y + extent,
+                                          -cascade.center.z - extent, -cascade.center.z + extent);
+        cascade.viewProjection = projection * lightView;
+        cascade.staticValid = false;
+    }
+
+    // casters of one kind that can throw a shadow into the cascade: drawn when `draw`, counted either way
+    unsigned int drawCasters(const std::vector<SceneObject>& objects, const DrawListBuilder& transforms,
+                             const Cascade& cascade, ShadowCasting kind, bool draw)
+    {
+        static const Uniform<glm::mat4> model("model");
+        unsigned int drawn = 0;
+        for (std::size_t i = 0; i < objects.size(); i++)
+        {
+            const SceneObject& object = objects[i];
+            if (object.shadow != kind)
+                continue;
+            const glm::mat4& world = transforms.transform(i);
+            if (object.model == nullptr)
+            {
+                if (!touches(cascade, object.boundsMin, object.boundsMax, world))
+                    continue;
+                drawn++;
+                if (!draw)
+                    continue;
+                casterShader->set(model, world);
+                glState().bindVertexArray(object.vao);
+                if (object.indexType == 0)
+                    glDrawArrays(object.mode, 0, object.count);
+                else
+                    glDrawElements(object.mode, object.count, object.indexType, 0);
+                current.casterDraws++;
+                continue;
+            }
+            for (unsigned int m = 0; m < object.model->meshes.size(); m++)
+            {
+                const Mesh& mesh = object.model->meshes[m];
+                if (!touches(cascade, mesh.boundsMin, mesh.boundsMax, world))
+                    continue;
+                drawn++;
+                if (!draw)
+                    continue;
+                casterShader->set(model, world);
+                glState().bindVertexArray(mesh.VAO);
+                glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, 0);
+                current.casterDraws++;
+            }
+        }
+        return drawn;
+    }
+
+    // bounding sphere of the box against the cascade; anything between the sun and the box counts (depth clamp)
+    bool touches(const Cascade& cascade, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& world) const
+    {
+        float scale = glm::max(glm::length(glm::vec3(world[0])), glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        float radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+        glm::vec3 center = glm::vec3(lightView * world * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+        return std::abs(center.x - cascade.center.x) <= cascade.extent + radius &&
+               std::abs(center.y - cascade.center.y) <= cascade.extent + radius &&
+               center.z + radius >= cascade.center.z - cascade.extent;
+    }
+};
+#endif
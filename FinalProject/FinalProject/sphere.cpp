@@ -15,15 +15,13 @@
 #include <windows.h>    // include windows.h to avoid thousands of compile errors even though this class is not depending on Windows
 #endif
 
-#ifdef __APPLE__
-#include <OpenGL/gl.h>
-#else
-#include <GL/gl.h>
-#endif
+#include <glad/glad.h>    // core profile: the draw functions use VAOs, not client arrays
+#include "gl_state.h"
 
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <xmmintrin.h>
 #include "Sphere.h"
 
 
@@ -37,7 +35,8 @@ const int MIN_STACK_COUNT = 2;
 ///////////////////////////////////////////////////////////////////////////////
 // ctor
 ///////////////////////////////////////////////////////////////////////////////
-Sphere::Sphere(float radius, int sectors, int stacks, bool smooth, int up) : interleavedStride(32)
+Sphere::Sphere(float radius, int sectors, int stacks, bool smooth, int up, bool retainArrays)
+    : retainArrays(retainArrays), interleavedStride(32), vao(0), vbo(0), ibo(0)
 {
     set(radius, sectors, stacks, smooth, up);
 }
@@ -62,10 +61,7 @@ void Sphere::set(float radius, int sectors, int stacks, bool smooth, int up)
     if (up < 1 || up > 3)
         this->upAxis = 3;
 
-    if (smooth)
-        buildVerticesSmooth();
-    else
-        buildVerticesFlat();
+    build();
 }
 
 void Sphere::setRadius(float radius)
@@ -92,10 +88,7 @@ void Sphere::setSmooth(bool smooth)
         return;
 
     this->smooth = smooth;
-    if (smooth)
-        buildVerticesSmooth();
-    else
-        buildVerticesFlat();
+    build();
 }
 
 void Sphere::setUpAxis(int up)
@@ -105,6 +98,27 @@ void Sphere::setUpAxis(int up)
 
     changeUpAxis(this->upAxis, up);
     this->upAxis = up;
+    if (vao != 0)
+        createBuffers();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// write the interleaved V/N/T vertices, the triangle indices and (optional)
+// the line indices straight to caller memory, e.g. buffer ranges mapped with
+// glMapBufferRange(); the sizes are getInterleavedVertexSize(),
+// getIndexSize() and getLineIndexSize(). Nothing is kept in the sphere, so a
+// sphere made with retainArrays=false never holds a CPU copy of its vertices.
+// The indices are the same as getIndices()/getLineIndices() would return.
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::generate(float* interleaved, unsigned int* indices, unsigned int* lineIndices)
+{
+    Target target = { interleaved, nullptr, nullptr, nullptr, indices, lineIndices };
+    if (smooth)
+        buildVerticesSmooth(target);
+    else
+        buildVerticesFlat(target);
 }
 
 
@@ -137,6 +151,8 @@ void Sphere::reverseNormals()
         indices[i] = indices[i + 2];
         indices[i + 2] = tmp;
     }
+    if (vao != 0)
+        createBuffers();
 }
 
 
@@ -162,66 +178,139 @@ void Sphere::printSelf() const
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// draw a sphere in VertexArray mode
-// OpenGL RC must be set before calling it
+// upload the arrays to a VAO owned by the sphere (OpenGL 3.3 core)
+// attributes: position(0), normal(1), tex coord(2) interleaved, then the
+// barycentric coordinate (3) of each vertex; the index buffer holds the
+// triangles followed by the lines. Called again by the setters while the
+// buffers exist, so the GL context must be current whenever they run
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::draw() const
+void Sphere::createBuffers()
+{
+    if (!retainArrays)
+    {
+        std::cout << "ERROR::SPHERE:: createBuffers() needs the arrays (retainArrays)" << std::endl;
+        return;
+    }
+    std::vector<unsigned char> barycentrics;
+    buildBarycentrics(barycentrics);
+
+    if (vao == 0)
+    {
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ibo);
+    }
+    glState().bindVertexArray(vao);
+
+    // interleaved vertices and the barycentrics in one buffer
+    GLsizeiptr interleavedSize = getInterleavedVertexSize();
+    glState().bindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, interleavedSize + barycentrics.size(), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, interleavedSize, interleavedVertices.data());
+    glBufferSubData(GL_ARRAY_BUFFER, interleavedSize, barycentrics.size(), barycentrics.data());
+
+    glState().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, getIndexSize() + getLineIndexSize(), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, getIndexSize(), indices.data());
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, getIndexSize(), getLineIndexSize(), lineIndices.data());
+
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, interleavedStride, (void*)0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, interleavedStride, (void*)(sizeof(float) * 3));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, interleavedStride, (void*)(sizeof(float) * 6));
+    glVertexAttribPointer(3, 3, GL_UNSIGNED_BYTE, GL_TRUE, 4, (void*)interleavedSize);
+    glState().bindVertexArray(0);
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// delete the VAO and buffers
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::releaseBuffers()
 {
-    // interleaved array
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glVertexPointer(3, GL_FLOAT, interleavedStride, &interleavedVertices[0]);
-    glNormalPointer(GL_FLOAT, interleavedStride, &interleavedVertices[3]);
-    glTexCoordPointer(2, GL_FLOAT, interleavedStride, &interleavedVertices[6]);
-
-    glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, indices.data());
-
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (vao == 0)
+        return;
+    glState().deleteVertexArray(vao);
+    glState().deleteBuffer(vbo);
+    glState().deleteBuffer(ibo);
+    vao = vbo = ibo = 0;
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// draw lines only
-// the caller must set the line width before call this
+// draw a sphere with its VAO (createBuffers() first)
+// the caller binds the program; it reads the attributes at locations 0-3
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::drawLines(const float lineColor[4]) const
+void Sphere::draw() const
 {
-    // set line colour
-    glColor4fv(lineColor);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, lineColor);
+    glState().bindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, (GLsizei)getIndexCount(), GL_UNSIGNED_INT, (void*)0);
+    glState().bindVertexArray(0);
+}
 
-    // draw lines with VA
-    glDisable(GL_LIGHTING);
-    glDisable(GL_TEXTURE_2D);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(3, GL_FLOAT, 0, vertices.data());
 
-    glDrawElements(GL_LINES, (unsigned int)lineIndices.size(), GL_UNSIGNED_INT, lineIndices.data());
 
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_TEXTURE_2D);
+///////////////////////////////////////////////////////////////////////////////
+// draw lines only, with the bound program (its color is up to the caller)
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::drawLines() const
+{
+    glState().bindVertexArray(vao);
+    glDrawElements(GL_LINES, (GLsizei)getLineIndexCount(), GL_UNSIGNED_INT, (void*)(std::size_t)getIndexSize());
+    glState().bindVertexArray(0);
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// draw a sphere surfaces and lines on top of it
-// the caller must set the line width before call this
+// draw a sphere surface and the edges of its triangles in a single pass
+// the bound program draws the edges from the barycentric attribute (3), e.g.
+// wireframe_vertex_shader.glsl / wireframe_fragment_shader.glsl; no second
+// pass with polygon offset, so it costs the same as draw()
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::drawWithLines(const float lineColor[4]) const
+void Sphere::drawWithLines() const
 {
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    glPolygonOffset(1.0, 1.0f); // move polygon backward
-    this->draw();
-    glDisable(GL_POLYGON_OFFSET_FILL);
+    draw();
+}
+
 
-    // draw lines with VA
-    drawLines(lineColor);
+
+///////////////////////////////////////////////////////////////////////////////
+// barycentric coordinate of every vertex: the vertices are 3-colored so each
+// triangle has one corner of each color, (1,0,0), (0,1,0) and (0,0,1); 4 bytes
+// (RGB + pad) per vertex
+// smooth: corners of quad (i,j) are k1=(i,j), k2=(i+1,j), k1+1=(i,j+1) and
+//         k2+1=(i+1,j+1), so color = (i + 2j) mod 3 differs in both triangles
+// flat: per sector v1,v2,v3(,v4) get 0,1,2(,0); v4 shares an edge with v2, v3
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::buildBarycentrics(std::vector<unsigned char>& barycentrics) const
+{
+    barycentrics.assign((std::size_t)vertexCount * 4, 0);
+    std::size_t vertex = 0;
+    for (int i = 0; i <= stackCount; ++i)
+    {
+        if (!smooth && i == stackCount)
+            break;
+        for (int j = 0; j <= sectorCount; ++j)
+        {
+            if (smooth)
+            {
+                barycentrics[vertex * 4 + (i + 2 * j) % 3] = 255;
+                ++vertex;
+            }
+            else if (j < sectorCount)
+            {
+                int corners = (i == 0 || i == stackCount - 1) ? 3 : 4;
+                for (int k = 0; k < corners; ++k, ++vertex)
+                    barycentrics[vertex * 4 + k % 3] = 255;
+            }
+        }
+    }
 }
 
 
@@ -253,77 +342,237 @@ void Sphere::updateRadius()
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// dealloc vectors
+// sin/cos tables of the sector and stack angles, computed once per build
+// instead of once per vertex; the angles are the same expressions as before
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::clearArrays()
+void Sphere::buildTables()
 {
-    std::vector<float>().swap(vertices);
-    std::vector<float>().swap(normals);
-    std::vector<float>().swap(texCoords);
-    std::vector<unsigned int>().swap(indices);
-    std::vector<unsigned int>().swap(lineIndices);
+    const float PI = acos(-1.0f);
+    float sectorStep = 2 * PI / sectorCount;
+    float stackStep = PI / stackCount;
+
+    // sector tables are padded to a multiple of 4 for the SIMD ring writer
+    std::size_t sectorSize = ((std::size_t)sectorCount + 1 + 3) & ~(std::size_t)3;
+    sectorCosines.assign(sectorSize, 0.0f);
+    sectorSines.assign(sectorSize, 0.0f);
+    sectorCoords.assign(sectorSize, 0.0f);
+    for (int j = 0; j <= sectorCount; ++j)
+    {
+        float sectorAngle = j * sectorStep;         // starting from 0 to 2pi
+        sectorCosines[j] = cosf(sectorAngle);
+        sectorSines[j] = sinf(sectorAngle);
+        sectorCoords[j] = (float)j / sectorCount;   // s
+    }
+
+    stackCosines.resize(stackCount + 1);
+    stackSines.resize(stackCount + 1);
+    for (int i = 0; i <= stackCount; ++i)
+    {
+        float stackAngle = PI / 2 - i * stackStep;  // starting from pi/2 to -pi/2
+        stackCosines[i] = cosf(stackAngle);
+        stackSines[i] = sinf(stackAngle);
+    }
 }
 
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// build vertices of sphere with smooth shading using parametric equation
-// x = r * cos(u) * cos(v)
-// y = r * cos(u) * sin(v)
-// z = r * sin(u)
-// where u: stack(latitude) angle (-90 <= u <= 90)
-//       v: sector(longitude) angle (0 <= v <= 360)
+// element counts of the current parameters, known before anything is built
+// smooth: (sectorCount+1) vertices per stack, no triangles at the pole rows
+// flat: 1 triangle per sector in the first and last stacks, a quad in others
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::buildVerticesSmooth()
+void Sphere::computeCounts()
 {
-    const float PI = acos(-1.0f);
+    if (smooth)
+    {
+        vertexCount = (unsigned int)((sectorCount + 1) * (stackCount + 1));
+        indexCount = (unsigned int)(6 * sectorCount * (stackCount - 1));
+        lineIndexCount = (unsigned int)(sectorCount * (4 * stackCount - 2));
+    }
+    else
+    {
+        vertexCount = (unsigned int)(sectorCount * (6 + 4 * (stackCount - 2)));
+        indexCount = (unsigned int)(sectorCount * (6 + 6 * (stackCount - 2)));
+        lineIndexCount = vertexCount;
+    }
+}
 
-    // clear memory of prev arrays
-    clearArrays();
 
-    float x, y, z, xy;                              // vertex position
-    float nx, ny, nz, lengthInv = 1.0f / radius;    // normal
-    float s, t;                                     // texCoord
 
-    float sectorStep = 2 * PI / sectorCount;
-    float stackStep = PI / stackCount;
-    float sectorAngle, stackAngle;
+///////////////////////////////////////////////////////////////////////////////
+// rebuild the member arrays for the current parameters, sized exactly
+// (capacity is kept across rebuilds); without retainArrays only the counts
+// are updated and the arrays are freed, generate() writes the vertices
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::build()
+{
+    computeCounts();
+    if (!retainArrays)
+    {
+        std::vector<float>().swap(vertices);
+        std::vector<float>().swap(normals);
+        std::vector<float>().swap(texCoords);
+        std::vector<float>().swap(interleavedVertices);
+        std::vector<unsigned int>().swap(indices);
+        std::vector<unsigned int>().swap(lineIndices);
+        return;
+    }
 
-    for (int i = 0; i <= stackCount; ++i)
+    vertices.resize((std::size_t)vertexCount * 3);
+    normals.resize((std::size_t)vertexCount * 3);
+    texCoords.resize((std::size_t)vertexCount * 2);
+    interleavedVertices.resize((std::size_t)vertexCount * 8);
+    indices.resize(indexCount);
+    lineIndices.resize(lineIndexCount);
+
+    Target target = { interleavedVertices.data(), vertices.data(), normals.data(), texCoords.data(),
+                      indices.data(), lineIndices.data() };
+    if (smooth)
+        buildVerticesSmooth(target);
+    else
+        buildVerticesFlat(target);
+
+    // keep the VAO in sync once it exists
+    if (vao != 0)
+        createBuffers();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// write vertex i to the interleaved and (if any) the separate arrays, turned
+// from the Z-up build space to the up axis (as changeUpAxis(3, upAxis) does)
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::putVertex(const Target& target, std::size_t i, float x, float y, float z, float nx, float ny, float nz, float s, float t)
+{
+    float tmp;
+    if (upAxis == 1)        // Z -> X
     {
-        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2
-        xy = radius * cosf(stackAngle);             // r * cos(u)
-        z = radius * sinf(stackAngle);              // r * sin(u)
+        tmp = x;  x = z;  z = -tmp;
+        tmp = nx; nx = nz; nz = -tmp;
+    }
+    else if (upAxis == 2)   // Z -> Y
+    {
+        tmp = y;  y = z;  z = -tmp;
+        tmp = ny; ny = nz; nz = -tmp;
+    }
 
-        // add (sectorCount+1) vertices per stack
-        // the first and last vertices have same position and normal, but different tex coords
-        for (int j = 0; j <= sectorCount; ++j)
+    float* v = target.interleaved + i * 8;
+    v[0] = x;  v[1] = y;  v[2] = z;
+    v[3] = nx; v[4] = ny; v[5] = nz;
+    v[6] = s;  v[7] = t;
+
+    if (!target.vertices)
+        return;
+    float* vertices = target.vertices;
+    float* normals = target.normals;
+    float* texCoords = target.texCoords;
+    vertices[i * 3] = x;     vertices[i * 3 + 1] = y;  vertices[i * 3 + 2] = z;
+    normals[i * 3] = nx;     normals[i * 3 + 1] = ny;  normals[i * 3 + 2] = nz;
+    texCoords[i * 2] = s;    texCoords[i * 2 + 1] = t;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// write one ring (stack) of the smooth sphere, starting at vertex first:
+// 4 sectors per SSE step, transposed into 4 interleaved V/N/T vertices
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::buildRing(const Target& target, std::size_t first, float xy, float z, float t)
+{
+    const float lengthInv = 1.0f / radius;
+    const int count = sectorCount + 1;
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 ringXY = _mm_set1_ps(xy);
+    const __m128 inv = _mm_set1_ps(lengthInv);
+    const __m128 ringZ = _mm_set1_ps(z);
+    const __m128 ringNZ = _mm_set1_ps(z * lengthInv);
+    const __m128 ringT = _mm_set1_ps(t);
+
+    int j = 0;
+    for (; j + 4 <= count; j += 4)
+    {
+        __m128 px = _mm_mul_ps(ringXY, _mm_loadu_ps(&sectorCosines[j]));    // r * cos(u) * cos(v)
+        __m128 py = _mm_mul_ps(ringXY, _mm_loadu_ps(&sectorSines[j]));      // r * cos(u) * sin(v)
+        __m128 pz = ringZ;                                                  // r * sin(u)
+        __m128 nx = _mm_mul_ps(px, inv);
+        __m128 ny = _mm_mul_ps(py, inv);
+        __m128 nz = ringNZ;
+        __m128 tmp;
+        if (upAxis == 1)
+        {
+            tmp = px; px = pz; pz = _mm_sub_ps(zero, tmp);
+            tmp = nx; nx = nz; nz = _mm_sub_ps(zero, tmp);
+        }
+        else if (upAxis == 2)
         {
-            sectorAngle = j * sectorStep;           // starting from 0 to 2pi
-
-            // vertex position
-            x = xy * cosf(sectorAngle);             // r * cos(u) * cos(v)
-            y = xy * sinf(sectorAngle);             // r * cos(u) * sin(v)
-            addVertex(x, y, z);
-
-            // normalized vertex normal
-            nx = x * lengthInv;
-            ny = y * lengthInv;
-            nz = z * lengthInv;
-            addNormal(nx, ny, nz);
-
-            // vertex tex coord between [0, 1]
-            s = (float)j / sectorCount;
-            t = (float)i / stackCount;
-            addTexCoord(s, t);
+            tmp = py; py = pz; pz = _mm_sub_ps(zero, tmp);
+            tmp = ny; ny = nz; nz = _mm_sub_ps(zero, tmp);
         }
+
+        // rows (x y z nx) and (ny nz s t) of 4 vertices -> one vertex per register
+        __m128 a0 = px, a1 = py, a2 = pz, a3 = nx;
+        __m128 b0 = ny, b1 = nz, b2 = _mm_loadu_ps(&sectorCoords[j]), b3 = ringT;
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        float* v = target.interleaved + (first + j) * 8;
+        _mm_storeu_ps(v, a0);      _mm_storeu_ps(v + 4, b0);
+        _mm_storeu_ps(v + 8, a1);  _mm_storeu_ps(v + 12, b1);
+        _mm_storeu_ps(v + 16, a2); _mm_storeu_ps(v + 20, b2);
+        _mm_storeu_ps(v + 24, a3); _mm_storeu_ps(v + 28, b3);
+
+        // separate arrays, straight from the interleaved vertices just written
+        if (!target.vertices)
+            continue;
+        for (int k = 0; k < 4; ++k)
+        {
+            const float* src = v + k * 8;
+            std::size_t i = first + j + k;
+            float* vertex = target.vertices + i * 3;
+            float* normal = target.normals + i * 3;
+            float* texCoord = target.texCoords + i * 2;
+            vertex[0] = src[0];   vertex[1] = src[1];   vertex[2] = src[2];
+            normal[0] = src[3];   normal[1] = src[4];   normal[2] = src[5];
+            texCoord[0] = src[6]; texCoord[1] = src[7];
+        }
+    }
+
+    // the remaining sectors of the ring
+    for (; j < count; ++j)
+    {
+        float x = xy * sectorCosines[j];
+        float y = xy * sectorSines[j];
+        putVertex(target, first + j, x, y, z, x * lengthInv, y * lengthInv, z * lengthInv, sectorCoords[j], t);
     }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// build vertices of sphere with smooth shading using parametric equation
+// x = r * cos(u) * cos(v)
+// y = r * cos(u) * sin(v)
+// z = r * sin(u)
+// where u: stack(latitude) angle (-90 <= u <= 90)
+//       v: sector(longitude) angle (0 <= v <= 360)
+///////////////////////////////////////////////////////////////////////////////
+void Sphere::buildVerticesSmooth(const Target& target)
+{
+    buildTables();
+
+    // (sectorCount+1) vertices per stack: the first and last vertices have same
+    // position and normal, but different tex coords
+    std::size_t ringSize = (std::size_t)sectorCount + 1;
+    for (int i = 0; i <= stackCount; ++i)
+        buildRing(target, i * ringSize, radius * stackCosines[i], radius * stackSines[i], (float)i / stackCount);
 
     // indices
     //  k1--k1+1
     //  |  / |
     //  | /  |
     //  k2--k2+1
+    unsigned int* index = target.indices;
+    unsigned int* line = target.lineIndices;
     unsigned int k1, k2;
     for (int i = 0; i < stackCount; ++i)
     {
@@ -335,31 +584,26 @@ void Sphere::buildVerticesSmooth()
             // 2 triangles per sector excluding 1st and last stacks
             if (i != 0)
             {
-                addIndices(k1, k2, k1 + 1);   // k1---k2---k1+1
+                *index++ = k1; *index++ = k2; *index++ = k1 + 1;        // k1---k2---k1+1
             }
 
             if (i != (stackCount - 1))
             {
-                addIndices(k1 + 1, k2, k2 + 1); // k1+1---k2---k2+1
+                *index++ = k1 + 1; *index++ = k2; *index++ = k2 + 1;    // k1+1---k2---k2+1
             }
 
             // vertical lines for all stacks
-            lineIndices.push_back(k1);
-            lineIndices.push_back(k2);
+            if (!line)
+                continue;
+            *line++ = k1;
+            *line++ = k2;
             if (i != 0)  // horizontal lines except 1st stack
             {
-                lineIndices.push_back(k1);
-                lineIndices.push_back(k1 + 1);
+                *line++ = k1;
+                *line++ = k1 + 1;
             }
         }
     }
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
-
-    // change up axis from Z-axis to the given
-    if (this->upAxis != 3)
-        changeUpAxis(3, this->upAxis);
 }
 
 
@@ -368,197 +612,113 @@ void Sphere::buildVerticesSmooth()
 // generate vertices with flat shading
 // each triangle is independent (no shared vertices)
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::buildVerticesFlat()
+void Sphere::buildVerticesFlat(const Target& target)
 {
-    const float PI = acos(-1.0f);
+    buildTables();
 
-    // tmp vertex definition (x,y,z,s,t)
+    // grid vertex (x,y,z,s,t) of stack i, sector j, straight from the tables
     struct Vertex
     {
         float x, y, z, s, t;
     };
-    std::vector<Vertex> tmpVertices;
-
-    float sectorStep = 2 * PI / sectorCount;
-    float stackStep = PI / stackCount;
-    float sectorAngle, stackAngle;
-
-    // compute all vertices first, each vertex contains (x,y,z,s,t) except normal
-    for (int i = 0; i <= stackCount; ++i)
-    {
-        stackAngle = PI / 2 - i * stackStep;        // starting from pi/2 to -pi/2
-        float xy = radius * cosf(stackAngle);       // r * cos(u)
-        float z = radius * sinf(stackAngle);        // r * sin(u)
-
-        // add (sectorCount+1) vertices per stack
-        // the first and last vertices have same position and normal, but different tex coords
-        for (int j = 0; j <= sectorCount; ++j)
-        {
-            sectorAngle = j * sectorStep;           // starting from 0 to 2pi
-
-            Vertex vertex;
-            vertex.x = xy * cosf(sectorAngle);      // x = r * cos(u) * cos(v)
-            vertex.y = xy * sinf(sectorAngle);      // y = r * cos(u) * sin(v)
-            vertex.z = z;                           // z = r * sin(u)
-            vertex.s = (float)j / sectorCount;        // s
-            vertex.t = (float)i / stackCount;         // t
-            tmpVertices.push_back(vertex);
-        }
-    }
-
-    // clear memory of prev arrays
-    clearArrays();
+    auto gridVertex = [this](int i, int j) {
+        float xy = radius * stackCosines[i];        // r * cos(u)
+        Vertex vertex;
+        vertex.x = xy * sectorCosines[j];           // x = r * cos(u) * cos(v)
+        vertex.y = xy * sectorSines[j];             // y = r * cos(u) * sin(v)
+        vertex.z = radius * stackSines[i];          // z = r * sin(u)
+        vertex.s = sectorCoords[j];                 // s
+        vertex.t = (float)i / stackCount;           // t
+        return vertex;
+    };
 
     Vertex v1, v2, v3, v4;                          // 4 vertex positions and tex coords
-    std::vector<float> n;                           // 1 face normal
+    float n[3];                                     // 1 face normal
 
-    int i, j, k, vi1, vi2;
-    int index = 0;                                  // index for vertex
-    for (i = 0; i < stackCount; ++i)
+    unsigned int* index = target.indices;
+    unsigned int* line = target.lineIndices;
+    unsigned int vertex = 0;                        // index for vertex
+    for (int i = 0; i < stackCount; ++i)
     {
-        vi1 = i * (sectorCount + 1);                // index of tmpVertices
-        vi2 = (i + 1) * (sectorCount + 1);
-
-        for (j = 0; j < sectorCount; ++j, ++vi1, ++vi2)
+        for (int j = 0; j < sectorCount; ++j)
         {
             // get 4 vertices per sector
             //  v1--v3
             //  |    |
             //  v2--v4
-            v1 = tmpVertices[vi1];
-            v2 = tmpVertices[vi2];
-            v3 = tmpVertices[vi1 + 1];
-            v4 = tmpVertices[vi2 + 1];
+            v1 = gridVertex(i, j);
+            v2 = gridVertex(i + 1, j);
+            v3 = gridVertex(i, j + 1);
+            v4 = gridVertex(i + 1, j + 1);
 
             // if 1st stack and last stack, store only 1 triangle per sector
             // otherwise, store 2 triangles (quad) per sector
             if (i == 0) // a triangle for first stack ==========================
             {
-                // put a triangle
-                addVertex(v1.x, v1.y, v1.z);
-                addVertex(v2.x, v2.y, v2.z);
-                addVertex(v4.x, v4.y, v4.z);
-
-                // put tex coords of triangle
-                addTexCoord(v1.s, v1.t);
-                addTexCoord(v2.s, v2.t);
-                addTexCoord(v4.s, v4.t);
-
-                // put normal
-                n = computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v4.x, v4.y, v4.z);
-                for (k = 0; k < 3; ++k)  // same normals for 3 vertices
-                {
-                    addNormal(n[0], n[1], n[2]);
-                }
+                computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v4.x, v4.y, v4.z, n);
+                putVertex(target, vertex, v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                putVertex(target, vertex + 1, v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                putVertex(target, vertex + 2, v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
 
                 // put indices of 1 triangle
-                addIndices(index, index + 1, index + 2);
+                *index++ = vertex; *index++ = vertex + 1; *index++ = vertex + 2;
 
                 // indices for line (first stack requires only vertical line)
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 1);
+                if (line)
+                {
+                    *line++ = vertex;
+                    *line++ = vertex + 1;
+                }
 
-                index += 3;     // for next
+                vertex += 3;    // for next
             }
             else if (i == (stackCount - 1)) // a triangle for last stack =========
             {
-                // put a triangle
-                addVertex(v1.x, v1.y, v1.z);
-                addVertex(v2.x, v2.y, v2.z);
-                addVertex(v3.x, v3.y, v3.z);
-
-                // put tex coords of triangle
-                addTexCoord(v1.s, v1.t);
-                addTexCoord(v2.s, v2.t);
-                addTexCoord(v3.s, v3.t);
-
-                // put normal
-                n = computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z);
-                for (k = 0; k < 3; ++k)  // same normals for 3 vertices
-                {
-                    addNormal(n[0], n[1], n[2]);
-                }
+                computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z, n);
+                putVertex(target, vertex, v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                putVertex(target, vertex + 1, v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                putVertex(target, vertex + 2, v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
 
                 // put indices of 1 triangle
-                addIndices(index, index + 1, index + 2);
+                *index++ = vertex; *index++ = vertex + 1; *index++ = vertex + 2;
 
                 // indices for lines (last stack requires both vert/hori lines)
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 1);
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 2);
+                if (line)
+                {
+                    *line++ = vertex;
+                    *line++ = vertex + 1;
+                    *line++ = vertex;
+                    *line++ = vertex + 2;
+                }
 
-                index += 3;     // for next
+                vertex += 3;    // for next
             }
             else // 2 triangles for others ====================================
             {
-                // put quad vertices: v1-v2-v3-v4
-                addVertex(v1.x, v1.y, v1.z);
-                addVertex(v2.x, v2.y, v2.z);
-                addVertex(v3.x, v3.y, v3.z);
-                addVertex(v4.x, v4.y, v4.z);
-
-                // put tex coords of quad
-                addTexCoord(v1.s, v1.t);
-                addTexCoord(v2.s, v2.t);
-                addTexCoord(v3.s, v3.t);
-                addTexCoord(v4.s, v4.t);
-
-                // put normal
-                n = computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z);
-                for (k = 0; k < 4; ++k)  // same normals for 4 vertices
-                {
-                    addNormal(n[0], n[1], n[2]);
-                }
+                // put quad vertices: v1-v2-v3-v4, same normal for all 4
+                computeFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z, n);
+                putVertex(target, vertex, v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                putVertex(target, vertex + 1, v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                putVertex(target, vertex + 2, v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
+                putVertex(target, vertex + 3, v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
 
                 // put indices of quad (2 triangles)
-                addIndices(index, index + 1, index + 2);
-                addIndices(index + 2, index + 1, index + 3);
+                *index++ = vertex; *index++ = vertex + 1; *index++ = vertex + 2;
+                *index++ = vertex + 2; *index++ = vertex + 1; *index++ = vertex + 3;
 
                 // indices for lines
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 1);
-                lineIndices.push_back(index);
-                lineIndices.push_back(index + 2);
+                if (line)
+                {
+                    *line++ = vertex;
+                    *line++ = vertex + 1;
+                    *line++ = vertex;
+                    *line++ = vertex + 2;
+                }
 
-                index += 4;     // for next
+                vertex += 4;    // for next
             }
         }
     }
-
-    // generate interleaved vertex array as well
-    buildInterleavedVertices();
-
-    // change up axis from Z-axis to the given
-    if (this->upAxis != 3)
-        changeUpAxis(3, this->upAxis);
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// generate interleaved vertices: V/N/T
-// stride must be 32 bytes
-///////////////////////////////////////////////////////////////////////////////
-void Sphere::buildInterleavedVertices()
-{
-    std::vector<float>().swap(interleavedVertices);
-
-    std::size_t i, j;
-    std::size_t count = vertices.size();
-    for (i = 0, j = 0; i < count; i += 3, j += 2)
-    {
-        interleavedVertices.push_back(vertices[i]);
-        interleavedVertices.push_back(vertices[i + 1]);
-        interleavedVertices.push_back(vertices[i + 2]);
-
-        interleavedVertices.push_back(normals[i]);
-        interleavedVertices.push_back(normals[i + 1]);
-        interleavedVertices.push_back(normals[i + 2]);
-
-        interleavedVertices.push_back(texCoords[j]);
-        interleavedVertices.push_back(texCoords[j + 1]);
-    }
 }
 
 
@@ -646,63 +806,17 @@ void Sphere::changeUpAxis(int from, int to)
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// add single vertex to array
+// face normal of a triangle v1-v2-v3 into normal[3]
+// if a triangle has no surface (normal length = 0), then it is a zero vector
 ///////////////////////////////////////////////////////////////////////////////
-void Sphere::addVertex(float x, float y, float z)
-{
-    vertices.push_back(x);
-    vertices.push_back(y);
-    vertices.push_back(z);
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// add single normal to array
-///////////////////////////////////////////////////////////////////////////////
-void Sphere::addNormal(float nx, float ny, float nz)
-{
-    normals.push_back(nx);
-    normals.push_back(ny);
-    normals.push_back(nz);
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// add single texture coord to array
-///////////////////////////////////////////////////////////////////////////////
-void Sphere::addTexCoord(float s, float t)
-{
-    texCoords.push_back(s);
-    texCoords.push_back(t);
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// add 3 indices to array
-///////////////////////////////////////////////////////////////////////////////
-void Sphere::addIndices(unsigned int i1, unsigned int i2, unsigned int i3)
-{
-    indices.push_back(i1);
-    indices.push_back(i2);
-    indices.push_back(i3);
-}
-
-
-
-///////////////////////////////////////////////////////////////////////////////
-// return face normal of a triangle v1-v2-v3
-// if a triangle has no surface (normal length = 0), then return a zero vector
-///////////////////////////////////////////////////////////////////////////////
-std::vector<float> Sphere::computeFaceNormal(float x1, float y1, float z1,  // v1
+void Sphere::computeFaceNormal(float x1, float y1, float z1,  // v1
     float x2, float y2, float z2,  // v2
-    float x3, float y3, float z3)  // v3
+    float x3, float y3, float z3,  // v3
+    float normal[3])
 {
     const float EPSILON = 0.000001f;
 
-    std::vector<float> normal(3, 0.0f);     // default return value (0,0,0)
+    normal[0] = normal[1] = normal[2] = 0.0f;   // default (0,0,0)
     float nx, ny, nz;
 
     // find 2 edge vectors: v1-v2, v1-v3
@@ -728,6 +842,4 @@ std::vector<float> Sphere::computeFaceNormal(float x1, float y1, float z1,  // v
         normal[1] = ny * lengthInv;
         normal[2] = nz * lengthInv;
     }
-
-    return normal;
 }
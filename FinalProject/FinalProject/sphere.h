@@ -5,6 +5,12 @@
 // The min number of sectors is 2 and the min number of stacks are 2.
 // The default up axis is +Z axis. You can change the up axis with setUpAxis():
 // X=1, Y=2, Z=3.
+// With retainArrays=false no vertex arrays are kept: the counts and sizes are
+// still valid and generate() writes the data into caller memory (e.g. mapped
+// GPU buffers); the array getters, createBuffers() and reverseNormals() need
+// arrays.
+// The draw functions are OpenGL 3.3 core: createBuffers() uploads the arrays
+// to a VAO owned by the sphere and the caller binds the program.
 //
 //  AUTHOR: Song Ho Ahn (song.ahn@gmail.com)
 // CREATED: 2017-11-01
@@ -14,13 +20,15 @@
 #ifndef GEOMETRY_SPHERE_H
 #define GEOMETRY_SPHERE_H
 
+#include <cstddef>
 #include <vector>
 
 class Sphere
 {
 public:
     // ctor/dtor
-    Sphere(float radius = 1.0f, int sectorCount = 36, int stackCount = 18, bool smooth = true, int up = 3);
+    Sphere(float radius = 1.0f, int sectorCount = 36, int stackCount = 18, bool smooth = true, int up = 3,
+           bool retainArrays = true);
     ~Sphere() {}
 
     // getters/setters
@@ -36,18 +44,21 @@ public:
     void setUpAxis(int up);
     void reverseNormals();
 
+    // write interleaved vertices, indices and lines (nullptr: skip) to caller memory
+    void generate(float* interleaved, unsigned int* indices, unsigned int* lineIndices = nullptr);
+
     // for vertex data
-    unsigned int getVertexCount() const { return (unsigned int)vertices.size() / 3; }
-    unsigned int getNormalCount() const { return (unsigned int)normals.size() / 3; }
-    unsigned int getTexCoordCount() const { return (unsigned int)texCoords.size() / 2; }
-    unsigned int getIndexCount() const { return (unsigned int)indices.size(); }
-    unsigned int getLineIndexCount() const { return (unsigned int)lineIndices.size(); }
+    unsigned int getVertexCount() const { return vertexCount; }
+    unsigned int getNormalCount() const { return vertexCount; }
+    unsigned int getTexCoordCount() const { return vertexCount; }
+    unsigned int getIndexCount() const { return indexCount; }
+    unsigned int getLineIndexCount() const { return lineIndexCount; }
     unsigned int getTriangleCount() const { return getIndexCount() / 3; }
-    unsigned int getVertexSize() const { return (unsigned int)vertices.size() * sizeof(float); }
-    unsigned int getNormalSize() const { return (unsigned int)normals.size() * sizeof(float); }
-    unsigned int getTexCoordSize() const { return (unsigned int)texCoords.size() * sizeof(float); }
-    unsigned int getIndexSize() const { return (unsigned int)indices.size() * sizeof(unsigned int); }
-    unsigned int getLineIndexSize() const { return (unsigned int)lineIndices.size() * sizeof(unsigned int); }
+    unsigned int getVertexSize() const { return vertexCount * 3 * sizeof(float); }
+    unsigned int getNormalSize() const { return vertexCount * 3 * sizeof(float); }
+    unsigned int getTexCoordSize() const { return vertexCount * 2 * sizeof(float); }
+    unsigned int getIndexSize() const { return indexCount * sizeof(unsigned int); }
+    unsigned int getLineIndexSize() const { return lineIndexCount * sizeof(unsigned int); }
     const float* getVertices() const { return vertices.data(); }
     const float* getNormals() const { return normals.data(); }
     const float* getTexCoords() const { return texCoords.data(); }
@@ -56,14 +67,17 @@ public:
 
     // for interleaved vertices: V/N/T
     unsigned int getInterleavedVertexCount() const { return getVertexCount(); }    // # of vertices
-    unsigned int getInterleavedVertexSize() const { return (unsigned int)interleavedVertices.size() * sizeof(float); }    // # of bytes
+    unsigned int getInterleavedVertexSize() const { return vertexCount * 8 * sizeof(float); }    // # of bytes
     int getInterleavedStride() const { return interleavedStride; }   // should be 32 bytes
     const float* getInterleavedVertices() const { return interleavedVertices.data(); }
 
-    // draw in VertexArray mode
-    void draw() const;                                  // draw surface
-    void drawLines(const float lineColor[4]) const;     // draw lines only
-    void drawWithLines(const float lineColor[4]) const; // draw surface and lines
+    // draw with the VAO: position(0), normal(1), tex coord(2), barycentric(3)
+    void createBuffers();                   // upload arrays (GL context current)
+    void releaseBuffers();                  // delete VAO and buffers
+    unsigned int getVao() const { return vao; }
+    void draw() const;                      // draw surface
+    void drawLines() const;                 // draw lines only
+    void drawWithLines() const;             // draw surface and lines in one pass
 
     // debug
     void printSelf() const;
@@ -71,19 +85,31 @@ public:
 protected:
 
 private:
+    // where a build writes: the member arrays, or caller memory for generate()
+    struct Target
+    {
+        float* interleaved;
+        float* vertices;                    // separate arrays, nullptr: skipped
+        float* normals;
+        float* texCoords;
+        unsigned int* indices;
+        unsigned int* lineIndices;          // nullptr: skipped
+    };
+
     // member functions
-    void buildVerticesSmooth();
-    void buildVerticesFlat();
-    void buildInterleavedVertices();
+    void build();
+    void buildVerticesSmooth(const Target& target);
+    void buildVerticesFlat(const Target& target);
+    void buildTables();
+    void buildRing(const Target& target, std::size_t first, float xy, float z, float t);
     void changeUpAxis(int from, int to);
-    void clearArrays();
-    void addVertex(float x, float y, float z);
-    void addNormal(float x, float y, float z);
-    void addTexCoord(float s, float t);
-    void addIndices(unsigned int i1, unsigned int i2, unsigned int i3);
-    std::vector<float> computeFaceNormal(float x1, float y1, float z1,
+    void buildBarycentrics(std::vector<unsigned char>& barycentrics) const;
+    void computeCounts();
+    void putVertex(const Target& target, std::size_t i, float x, float y, float z, float nx, float ny, float nz, float s, float t);
+    static void computeFaceNormal(float x1, float y1, float z1,
         float x2, float y2, float z2,
-        float x3, float y3, float z3);
+        float x3, float y3, float z3,
+        float normal[3]);
 
     // memeber vars
     float radius;
@@ -91,6 +117,10 @@ private:
     int stackCount;                         // latitude, # of stacks
     bool smooth;
     int upAxis;                             // +X=1, +Y=2, +z=3 (default)
+    bool retainArrays;                      // keep the arrays below, or only generate()
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    unsigned int lineIndexCount;
     std::vector<float> vertices;
     std::vector<float> normals;
     std::vector<float> texCoords;
@@ -101,6 +131,18 @@ private:
     std::vector<float> interleavedVertices;
     int interleavedStride;                  // # of bytes to hop to the next vertex (should be 32 bytes)
 
+    // GL objects of the draw functions, 0 until createBuffers()
+    unsigned int vao;
+    unsigned int vbo;                       // interleaved V/N/T, then barycentrics
+    unsigned int ibo;                       // triangles, then lines
+
+    // sin/cos of the sector and stack angles, rebuilt with the sphere (sector tables padded to 4)
+    std::vector<float> sectorCosines;
+    std::vector<float> sectorSines;
+    std::vector<float> sectorCoords;        // s tex coord of each sector
+    std::vector<float> stackCosines;
+    std::vector<float> stackSines;
+
 };
 
 #endif
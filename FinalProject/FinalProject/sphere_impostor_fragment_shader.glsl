@@ -0,0 +1,112 @@
+#version 330 core
+// the ray-cast depth is never in front of the quad: early depth tests stay on where this is supported
+#ifdef GL_ARB_conservative_depth
+#extension GL_ARB_conservative_depth : enable
+layout (depth_greater) out float gl_FragDepth;
+#endif
+out vec4 FragColor;
+
+in vec3 RayEnd;
+flat in vec4 CenterRadius;
+flat in vec3 Color;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// light sources, positions are already in view space (LightUniforms in uniform_blocks.h)
+#define MAX_POINT_LIGHTS 8
+struct PointLightData
+{
+    vec4 position;
+    vec4 color;
+};
+layout (std140) uniform LightData
+{
+    PointLightData lights[MAX_POINT_LIGHTS];
+    int lightCount;
+};
+
+// directional sun and its shadow cascades, matrices map view space to the shadow map (ShadowUniforms in uniform_blocks.h)
+#define SHADOW_CASCADES 4
+layout (std140) uniform ShadowData
+{
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    vec4 cascadeSplits;
+    vec4 cascadeTexels;
+    vec4 sunDirection;
+    vec4 sunColor;
+};
+uniform sampler2DArrayShadow shadowMap;
+
+// 1 lit, 0 shadowed: 3x3 taps of hardware PCF in the first cascade that covers the fragment, looked up a
+// texel and a half along the normal so surfaces don't shadow themselves
+float sunVisibility(vec3 position, vec3 normal)
+{
+    float depth = -position.z;
+    if (depth > cascadeSplits[SHADOW_CASCADES - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < SHADOW_CASCADES - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+    vec4 coord = cascadeMatrices[cascade] * vec4(position + normal * cascadeTexels[cascade] * 1.5, 1.0);
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, float(cascade), min(coord.z, 1.0)));
+    return lit / 9.0;
+}
+
+// ray from the eye through the pixel against the sphere: |t * dir - center|^2 = radius^2, nearest root. The hit
+// gives the real depth and normal, so the sphere is lit and intersects other geometry like a mesh would
+void main()
+{
+    vec3 center = CenterRadius.xyz;
+    float radius = CenterRadius.w;
+    vec3 dir = normalize(RayEnd);
+    float b = dot(dir, center);
+    float discriminant = b * b - (dot(center, center) - radius * radius);
+    if (discriminant < 0.0)
+        discard;
+    vec3 position = (b - sqrt(discriminant)) * dir;
+    vec3 norm = (position - center) / radius;
+
+    vec4 clip = projection * vec4(position, 1.0);
+    gl_FragDepth = ((gl_DepthRange.far - gl_DepthRange.near) * (clip.z / clip.w) + gl_DepthRange.near + gl_DepthRange.far) * 0.5;
+
+    // the phong terms of the untextured objects
+    float ambientStrength = 0.1;
+    float specularStrength = 0.5;
+    vec3 viewDir = -dir;
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+    for (int i = 0; i < lightCount; ++i)
+    {
+        vec3 lightColor = lights[i].color.rgb;
+        ambient += ambientStrength * lightColor;
+        vec3 lightDir = normalize(lights[i].position.xyz - position);
+        diffuse += max(dot(norm, lightDir), 0.0) * lightColor;
+        vec3 reflectDir = reflect(-lightDir, norm);
+        specular += specularStrength * pow(max(dot(viewDir, reflectDir), 0.0), 32) * lightColor;
+    }
+
+    // directional sun, dimmed by the cascades when they were drawn this frame
+    float sunDiffuse = max(dot(norm, sunDirection.xyz), 0.0);
+    float visibility = 1.0;
+    if (sunColor.a > 0.0 && sunDiffuse > 0.0)
+        visibility = sunVisibility(position, norm);
+    diffuse += visibility * sunDiffuse * sunColor.rgb;
+    vec3 sunReflect = reflect(-sunDirection.xyz, norm);
+    specular += visibility * specularStrength * pow(max(dot(viewDir, sunReflect), 0.0), 32) * sunColor.rgb;
+
+    FragColor = vec4((ambient + diffuse + specular) * Color, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#version 330 core
+layout (location = 0) in vec4 aCenterRadius;    // world space center and radius, one per instance
+layout (location = 1) in vec4 aColor;           // RGBA8, normalized
+
+out vec3 RayEnd;
+flat out vec4 CenterRadius;
+flat out vec3 Color;
+
+// per-frame camera data, shared by all programs (FrameUniforms in uniform_blocks.h)
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    float time;
+    float deltaTime;
+};
+
+// one quad per sphere (SphereImpostors in sphere_impostors.h), facing the camera and touching the sphere at
+// its nearest point: a square of the radius there covers the whole silhouette, and every point of the sphere
+// lies behind it. The fragment shader casts a ray through each covered pixel
+void main()
+{
+    vec3 center = (view * vec4(aCenterRadius.xyz, 1.0)).xyz;
+    float radius = aCenterRadius.w;
+    float distance = length(center);
+    CenterRadius = vec4(center, radius);
+    Color = aColor.rgb;
+    RayEnd = vec3(0.0);
+    // the camera is inside the sphere: nothing to draw, the vertex is put beyond the far plane
+    if (distance <= radius)
+    {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
+
+    vec3 forward = center / distance;
+    vec3 helper = abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 right = normalize(cross(helper, forward));
+    vec3 up = cross(forward, right);
+    // triangle strip corners (-1,-1) (1,-1) (-1,1) (1,1)
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+    RayEnd = center - forward * radius + (right * corner.x + up * corner.y) * radius;
+    gl_Position = projection * vec4(RayEnd, 1.0);
+}
\ No newline at end of file
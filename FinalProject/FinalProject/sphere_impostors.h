@@ -0,0 +1,104 @@
+#ifndef SPHERE_IMPOSTORS_H
+#define SPHERE_IMPOSTORS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "shader.h"
+#include "shadow_maps.h"
+#include "uniform_blocks.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Ray-cast sphere impostors, for clouds of spheres far beyond what tessellated meshes allow. A sphere is one
+// instance of 20 bytes (world center, radius, RGBA8 color) drawn as a 4 vertex camera-facing quad; the fragment
+// shader intersects the pixel's ray with the exact sphere, discards the misses and writes the hit's depth and
+// normal, so the spheres are round at any distance, lit like the phong objects (scene lights and the shadowed
+// sun) and intersect the rest of the scene correctly.
+//
+// Drawn in the forward color pass only; impostors receive sun shadows but don't cast any.
+class SphereImpostors
+{
+public:
+    struct Instance {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 1.0f;
+        uint32_t color = 0xFFFFFFFFu;   // RGBA8, red in the lowest byte (packColor)
+    };
+
+    // program and the instance VAO; the instances come with upload()
+    // ------------------------------------------------------------------------
+    void create()
+    {
+        shader.reset(new Shader("sphere_impostor_vertex_shader.glsl", "sphere_impostor_fragment_shader.glsl"));
+        bindUniformBlocks(shader->ID);
+        shader->use();
+        shader->setInt("shadowMap", SHADOW_MAP_UNIT);
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &instanceBuffer);
+        glState().bindVertexArray(vao);
+        glState().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)offsetof(Instance, color));
+        glVertexAttribDivisor(1, 1);
+        glState().bindVertexArray(0);
+    }
+
+    // delete the program, VAO and instance buffer, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        if (shader)
+            glState().deleteProgram(shader->ID);
+        shader.reset();
+        glState().deleteVertexArray(vao);
+        glState().deleteBuffer(instanceBuffer);
+        vao = instanceBuffer = 0;
+        count = 0;
+    }
+
+    // replace all instances; static data, upload again only when the set changes
+    // ------------------------------------------------------------------------
+    void upload(const std::vector<Instance>& instances)
+    {
+        count = static_cast<GLsizei>(instances.size());
+        glState().bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STATIC_DRAW);
+    }
+
+    // every instance in one call; FrameData, LightData and ShadowData must be uploaded for the frame
+    // ------------------------------------------------------------------------
+    void draw() const
+    {
+        if (count == 0)
+            return;
+        shader->use();
+        glState().bindVertexArray(vao);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    }
+
+    // number of spheres uploaded
+    GLsizei size() const { return count; }
+
+    static uint32_t packColor(const glm::vec3& color)
+    {
+        glm::vec3 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return uint32_t(c.r) | (uint32_t(c.g) << 8) | (uint32_t(c.b) << 16) | 0xFF000000u;
+    }
+
+private:
+    std::unique_ptr<Shader> shader;
+    GLuint vao = 0;
+    GLuint instanceBuffer = 0;
+    GLsizei count = 0;
+};
+#endif
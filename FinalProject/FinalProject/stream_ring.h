@@ -0,0 +1,168 @@
+#ifndef STREAM_RING_H
+#define STREAM_RING_H
+
+#include <glad/glad.h>
+
+#include "gl_ext.h"
+#include "gl_state.h"
+
+#include <iostream>
+#include <vector>
+
+// Ring of per-frame regions in one buffer object for data that is rewritten every frame (per-object
+// transforms and material constants, indirect commands). Each frame writes its own region while the GPU may
+// still be reading the regions of the previous frames; a fence per region keeps the CPU from overwriting a
+// region before the GPU is done with it.
+//
+// With buffer storage (GL 4.4) the whole ring stays persistently mapped and writes go straight to GPU
+// visible memory. On 3.3 the frame is written to a CPU staging copy and uploaded with an orphaning
+// glBufferData + glBufferSubData, which gives the same "never wait for the GPU" behaviour without fences.
+//
+// usage per frame:  ptr = ring.begin(size); write ... ; base = ring.end();  then draw with offsets base + n
+class StreamRing
+{
+public:
+    static const unsigned int FRAMES_IN_FLIGHT = 3;
+
+    // ------------------------------------------------------------------------
+    void create(GLsizeiptr frameCapacity)
+    {
+        persistentMapping = glExt().hasBufferStorage;
+        allocate(frameCapacity);
+    }
+
+    // delete the buffer and fences, while the context is still current
+    // ------------------------------------------------------------------------
+    void release()
+    {
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+        {
+            if (fences[i] != nullptr)
+                glDeleteSync(fences[i]);
+            fences[i] = nullptr;
+        }
+        if (buffer != 0)
+        {
+            if (mapped != nullptr)
+            {
+                glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            glState().deleteBuffer(buffer);
+        }
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+    // start writing this frame's data: fences the region written last frame, moves to the next region and
+    // waits until the GPU has finished reading it; returns where to write `size` bytes
+    // ------------------------------------------------------------------------
+    unsigned char* begin(GLsizeiptr size)
+    {
+        if (!persistentMapping)
+        {
+            if (size > capacity)
+                allocate(size);
+            staging.resize(static_cast<std::size_t>(size));
+            writeSize = size;
+            return staging.data();
+        }
+
+        if (writing)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        writing = true;
+        if (size > capacity)
+        {
+            // growing the persistent buffer means recreating it: wait until nothing reads the old one
+            waitAll();
+            release();
+            allocate(size * 2);
+        }
+
+        region = (region + 1) % FRAMES_IN_FLIGHT;
+        waitFor(region);
+        writeSize = size;
+        return mapped + region * capacity;
+    }
+
+    // publish the bytes written since begin(); returns the buffer offset of the frame's first byte
+    // ------------------------------------------------------------------------
+    GLintptr end()
+    {
+        if (persistentMapping)
+            return static_cast<GLintptr>(region * capacity);  // coherent mapping: nothing left to do
+
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+        if (writeSize > 0)
+            glBufferSubData(GL_COPY_WRITE_BUFFER, 0, writeSize, staging.data());
+        return 0;
+    }
+
+    GLuint id() const { return buffer; }
+    bool persistent() const { return persistentMapping; }
+
+    // round up to the next multiple of alignment (offset alignments are powers of two)
+    static GLsizeiptr align(GLsizeiptr value, GLsizeiptr alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+private:
+    GLuint buffer = 0;
+    GLsizeiptr capacity = 0;        // bytes per region
+    unsigned char* mapped = nullptr;
+    std::vector<unsigned char> staging;
+    GLsizeiptr writeSize = 0;
+    GLsync fences[FRAMES_IN_FLIGHT] = { nullptr, nullptr, nullptr };
+    unsigned int region = 0;
+    bool writing = false;
+    bool persistentMapping = false;
+
+    void allocate(GLsizeiptr frameCapacity)
+    {
+        // regions start at offsets every binding target accepts
+        capacity = align(frameCapacity > 0 ? frameCapacity : 1, 256);
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+        glState().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+
+        if (!persistentMapping)
+        {
+            glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+            return;
+        }
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr total = capacity * FRAMES_IN_FLIGHT;
+        glExt().BufferStorage(GL_COPY_WRITE_BUFFER, total, nullptr, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags));
+        if (mapped == nullptr)
+        {
+            // mapping failed; fall back to the orphaning path with a fresh mutable buffer
+            std::cout << "ERROR::STREAM_RING::PERSISTENT_MAP_FAILED, falling back to glBufferSubData" << std::endl;
+            glState().deleteBuffer(buffer);
+            buffer = 0;
+            persistentMapping = false;
+            allocate(frameCapacity);
+        }
+    }
+
+    void waitFor(unsigned int index)
+    {
+        if (fences[index] == nullptr)
+            return;
+        // flush on the first wait so the fence is guaranteed to signal
+        GLenum result = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+            result = glClientWaitSync(fences[index], 0, 1000000); // 1 ms
+        glDeleteSync(fences[index]);
+        fences[index] = nullptr;
+    }
+
+    void waitAll()
+    {
+        for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++)
+            waitFor(i);
+    }
+};
+#endif
@@ -0,0 +1,186 @@
+#ifndef TRANSFORM_STAGE_H
+#define TRANSFORM_STAGE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <vector>
+
+#include <xmmintrin.h>
+
+// every matrix the shaders need for one object, laid out like the matrix part of ObjectData (std140)
+struct ObjectMatrices {
+    glm::mat4 world;
+    glm::mat4 modelView;
+    glm::mat4 modelViewProjection;
+    glm::vec4 normal[3];        // inverse transpose of modelView's upper 3x3, as std140 mat3 columns
+};
+
+// Per-frame transform stage. Objects are stored as structure-of-arrays translation / rotation quaternion /
+// scale, and compute() turns four objects at a time (one per SSE lane) into their world, model-view,
+// model-view-projection and normal matrices, so the shaders read finished matrices instead of multiplying
+// and inverting per vertex.
+//
+// No general inverse is needed for the normal matrix: with world = T * R * S and an orthonormal view, the
+// inverse transpose of (view * R * S) is view * R * S^-1, i.e. the model-view columns divided by the squared
+// scale of their axis.
+//
+// Arrays are padded to whole SSE groups with identity objects. compute() over disjoint ranges that start on
+// a group boundary can run on several threads at once.
+class TransformStage
+{
+public:
+    enum { LANES = 4 };
+
+    // SoA inputs, one entry per object (plus padding)
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+    std::vector<float> scaleX, scaleY, scaleZ;
+
+    // ------------------------------------------------------------------------
+    void resize(std::size_t count)
+    {
+        objects = count;
+        std::size_t padded = (count + LANES - 1) / LANES * LANES;
+        positionX.resize(padded, 0.0f);
+        positionY.resize(padded, 0.0f);
+        positionZ.resize(padded, 0.0f);
+        rotationX.resize(padded, 0.0f);
+        rotationY.resize(padded, 0.0f);
+        rotationZ.resize(padded, 0.0f);
+        rotationW.resize(padded, 1.0f);
+        scaleX.resize(padded, 1.0f);
+        scaleY.resize(padded, 1.0f);
+        scaleZ.resize(padded, 1.0f);
+        output.resize(padded);
+    }
+
+    void set(std::size_t i, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        positionX[i] = position.x;
+        positionY[i] = position.y;
+        positionZ[i] = position.z;
+        rotationX[i] = rotation.x;
+        rotationY[i] = rotation.y;
+        rotationZ[i] = rotation.z;
+        rotationW[i] = rotation.w;
+        scaleX[i] = scale.x;
+        scaleY[i] = scale.y;
+        scaleZ[i] = scale.z;
+    }
+
+    void setCamera(const glm::mat4& view, const glm::mat4& projection)
+    {
+        this->view = view;
+        viewProjection = projection * view;
+    }
+
+    // matrices of objects [first, last); first must be a multiple of LANES, last is rounded up to one
+    // ------------------------------------------------------------------------
+    void compute(std::size_t first, std::size_t last)
+    {
+        __m128 v[4][4], vp[4][4];
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+            {
+                v[c][r] = _mm_set1_ps(view[c][r]);
+                vp[c][r] = _mm_set1_ps(viewProjection[c][r]);
+            }
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+
+        for (std::size_t i = first; i < last; i += LANES)
+        {
+            __m128 qx = _mm_loadu_ps(&rotationX[i]), qy = _mm_loadu_ps(&rotationY[i]);
+            __m128 qz = _mm_loadu_ps(&rotationZ[i]), qw = _mm_loadu_ps(&rotationW[i]);
+            __m128 scale[3] = { _mm_loadu_ps(&scaleX[i]), _mm_loadu_ps(&scaleY[i]), _mm_loadu_ps(&scaleZ[i]) };
+
+            // rotation matrix of the quaternion, columns
+            __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+            __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+            __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+            __m128 rotation[3][3] = {
+                { _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_mul_ps(two, _mm_sub_ps(xz, wy)) },
+                { _mm_mul_ps(two, _mm_sub_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_add_ps(yz, wx)) },
+                { _mm_mul_ps(two, _mm_add_ps(xz, wy)), _mm_mul_ps(two, _mm_sub_ps(yz, wx)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))) }
+            };
+
+            // world = T * R * S
+            __m128 world[4][4];
+            for (int c = 0; c < 3; c++)
+            {
+                for (int r = 0; r < 3; r++)
+                    world[c][r] = _mm_mul_ps(rotation[c][r], scale[c]);
+                world[c][3] = zero;
+            }
+            world[3][0] = _mm_loadu_ps(&positionX[i]);
+            world[3][1] = _mm_loadu_ps(&positionY[i]);
+            world[3][2] = _mm_loadu_ps(&positionZ[i]);
+            world[3][3] = one;
+
+            __m128 modelView[4][4], modelViewProjection[4][4], normal[3][4];
+            multiply(v, world, modelView);
+            multiply(vp, world, modelViewProjection);
+            for (int c = 0; c < 3; c++)
+            {
+                __m128 inverseSquare = _mm_div_ps(one, _mm_mul_ps(scale[c], scale[c]));
+                for (int r = 0; r < 3; r++)
+                    normal[c][r] = _mm_mul_ps(modelView[c][r], inverseSquare);
+                normal[c][3] = zero;
+            }
+
+            store(world, &output[i], &ObjectMatrices::world);
+            store(modelView, &output[i], &ObjectMatrices::modelView);
+            store(modelViewProjection, &output[i], &ObjectMatrices::modelViewProjection);
+            storeNormals(normal, &output[i]);
+        }
+    }
+
+    const ObjectMatrices& matrices(std::size_t i) const { return output[i]; }
+    std::size_t size() const { return objects; }
+
+private:
+    std::size_t objects = 0;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<ObjectMatrices> output;
+
+    // result = a * b for four matrices b at once, a the same in every lane; both column-major
+    static void multiply(const __m128 a[4][4], const __m128 b[4][4], __m128 result[4][4])
+    {
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                result[c][r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0][r], b[c][0]), _mm_mul_ps(a[1][r], b[c][1])),
+                                          _mm_add_ps(_mm_mul_ps(a[2][r], b[c][2]), _mm_mul_ps(a[3][r], b[c][3])));
+    }
+
+    // lanes hold one element of four objects; a 4x4 transpose per column turns them back into columns
+    static void store(__m128 m[4][4], ObjectMatrices* out, glm::mat4 ObjectMatrices::* member)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            __m128 r0 = m[c][0], r1 = m[c][1], r2 = m[c][2], r3 = m[c][3];
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&(out[0].*member)[c][0], r0);
+            _mm_storeu_ps(&(out[1].*member)[c][0], r1);
+            _mm_storeu_ps(&(out[2].*member)[c][0], r2);
+            _mm_storeu_ps(&(out[3].*member)[c][0], r3);
+        }
+    }
+
+    static void storeNormals(__m128 m[3][4], ObjectMatrices* out)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 r0 = m[c][0], r1 = m[c][1], r2 = m[c][2], r3 = m[c][3];
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&out[0].normal[c][0], r0);
+            _mm_storeu_ps(&out[1].normal[c][0], r1);
+            _mm_storeu_ps(&out[2].normal[c][0], r2);
+            _mm_storeu_ps(&out[3].normal[c][0], r3);
+        }
+    }
+};
+#endif
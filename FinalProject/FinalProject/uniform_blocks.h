@@ -0,0 +1,168 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+
+#include <cstddef>
+
+// C++ mirrors of the std140 uniform blocks shared by every program. Each block is uploaded once per frame
+// into its own UBO and bound to a fixed binding point, so the number of uniform calls per frame no longer
+// grows with the number of programs. The GLSL declarations are repeated in each shader that uses a block;
+// keep them in sync with the structs below (the static_asserts pin the std140 offsets).
+
+// binding points, assigned to every program by bindUniformBlocks()
+#define FRAME_UBO_BINDING 0
+#define LIGHT_UBO_BINDING 1
+#define OBJECT_UBO_BINDING 2
+#define CLUSTER_UBO_BINDING 3
+#define SHADOW_UBO_BINDING 4
+
+// layout (std140) uniform FrameData
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;   // world space, w unused
+    float time;                 // seconds since startup
+    float deltaTime;
+    float pad0;
+    float pad1;
+};
+static_assert(offsetof(FrameUniforms, view) == 0, "std140: FrameData.view");
+static_assert(offsetof(FrameUniforms, projection) == 64, "std140: FrameData.projection");
+static_assert(offsetof(FrameUniforms, viewProjection) == 128, "std140: FrameData.viewProjection");
+static_assert(offsetof(FrameUniforms, cameraPosition) == 192, "std140: FrameData.cameraPosition");
+static_assert(offsetof(FrameUniforms, time) == 208, "std140: FrameData.time");
+static_assert(offsetof(FrameUniforms, deltaTime) == 212, "std140: FrameData.deltaTime");
+static_assert(sizeof(FrameUniforms) == 224, "std140: FrameData size");
+
+// must match MAX_POINT_LIGHTS in the shaders
+#define MAX_POINT_LIGHTS 8
+
+// struct PointLightData inside LightData
+struct PointLightUniforms {
+    glm::vec4 position;         // view space, w unused
+    glm::vec4 color;            // rgb, a unused
+};
+static_assert(sizeof(PointLightUniforms) == 32, "std140: PointLightData size");
+
+// layout (std140) uniform LightData
+struct LightUniforms {
+    PointLightUniforms lights[MAX_POINT_LIGHTS];
+    GLint lightCount;
+    GLint pad0;
+    GLint pad1;
+    GLint pad2;
+};
+static_assert(offsetof(LightUniforms, lights) == 0, "std140: LightData.lights");
+static_assert(offsetof(LightUniforms, lightCount) == 32 * MAX_POINT_LIGHTS, "std140: LightData.lightCount");
+static_assert(sizeof(LightUniforms) == 32 * MAX_POINT_LIGHTS + 16, "std140: LightData size");
+
+// layout (std140) uniform ObjectData, one per draw; streamed by RenderQueue and bound with an offset. The
+// matrices come precomputed from the transform stage (transform_stage.h), shaders never invert per vertex
+struct ObjectUniforms {
+    glm::mat4 model;
+    glm::mat4 modelView;
+    glm::mat4 modelViewProjection;
+    glm::vec4 normalMatrix[3];  // mat3: inverse transpose of modelView, one vec4 per column in std140
+    glm::vec4 color;            // objectColor of the untextured programs, a = LOD crossfade coverage (1 = solid)
+};
+static_assert(offsetof(ObjectUniforms, model) == 0, "std140: ObjectData.model");
+static_assert(offsetof(ObjectUniforms, modelView) == 64, "std140: ObjectData.modelView");
+static_assert(offsetof(ObjectUniforms, modelViewProjection) == 128, "std140: ObjectData.modelViewProjection");
+static_assert(offsetof(ObjectUniforms, normalMatrix) == 192, "std140: ObjectData.normalMatrix");
+static_assert(offsetof(ObjectUniforms, color) == 240, "std140: ObjectData.objectColor");
+static_assert(sizeof(ObjectUniforms) == 256, "std140: ObjectData size");
+
+// layout (std140) uniform ClusterData, the clustered light grid of LightClusterer (light_clusters.h)
+struct ClusterUniforms {
+    glm::vec4 screen;           // framebuffer width, height, GRID_X / width, GRID_Y / height
+    glm::vec4 slicing;          // slice = log(viewDepth) * x + y; near and far plane in z, w
+    glm::ivec4 grid;            // cluster counts x, y, z and the number of clustered lights
+};
+static_assert(offsetof(ClusterUniforms, screen) == 0, "std140: ClusterData.clusterScreen");
+static_assert(offsetof(ClusterUniforms, slicing) == 16, "std140: ClusterData.clusterSlicing");
+static_assert(offsetof(ClusterUniforms, grid) == 32, "std140: ClusterData.clusterGrid");
+static_assert(sizeof(ClusterUniforms) == 48, "std140: ClusterData size");
+
+// must match SHADOW_CASCADES in the shaders
+#define SHADOW_CASCADES 4
+
+// layout (std140) uniform ShadowData, the directional sun and its cascades (ShadowMapper in shadow_maps.h)
+struct ShadowUniforms {
+    glm::mat4 cascadeMatrices[SHADOW_CASCADES];   // view space to shadow map [0,1] texture space, per cascade
+    glm::vec4 cascadeSplits;    // far view depth of each cascade
+    glm::vec4 cascadeTexels;    // world size of one shadow map texel, per cascade
+    glm::vec4 sunDirection;     // view space, towards the sun, w unused
+    glm::vec4 sunColor;         // rgb, a = 1 when the cascades hold this frame's shadows
+};
+static_assert(offsetof(ShadowUniforms, cascadeMatrices) == 0, "std140: ShadowData.cascadeMatrices");
+static_assert(offsetof(ShadowUniforms, cascadeSplits) == 64 * SHADOW_CASCADES, "std140: ShadowData.cascadeSplits");
+static_assert(offsetof(ShadowUniforms, cascadeTexels) == 64 * SHADOW_CASCADES + 16, "std140: ShadowData.cascadeTexels");
+static_assert(offsetof(ShadowUniforms, sunDirection) == 64 * SHADOW_CASCADES + 32, "std140: ShadowData.sunDirection");
+static_assert(offsetof(ShadowUniforms, sunColor) == 64 * SHADOW_CASCADES + 48, "std140: ShadowData.sunColor");
+static_assert(sizeof(ShadowUniforms) == 64 * SHADOW_CASCADES + 64, "std140: ShadowData size");
+
+// one UBO holding a single block of type T, bound to a fixed binding point
+template <typename T>
+class UniformBlock
+{
+public:
+    T data;
+
+    explicit UniformBlock(GLuint binding) : data(), binding(binding)
+    {
+        glGenBuffers(1, &buffer);
+        glState().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glState().bindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+    // delete the buffer, while the context is still current
+    void release()
+    {
+        glState().deleteBuffer(buffer);
+        buffer = 0;
+    }
+
+    // push `data` to the GPU, once per frame (orphaned, so last frame's draws never make us wait)
+    void upload()
+    {
+        glState().bindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glState().bindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    }
+
+private:
+    GLuint binding;
+    GLuint buffer = 0;
+
+    UniformBlock(const UniformBlock&) = delete;
+    UniformBlock& operator=(const UniformBlock&) = delete;
+};
+
+// point a program's FrameData/LightData/ObjectData/ClusterData/ShadowData blocks (where it has them) at the fixed binding points;
+// GLSL 330 has no layout(binding) for blocks, so this runs once after linking
+inline void bindUniformBlocks(GLuint program)
+{
+    GLuint frame = glGetUniformBlockIndex(program, "FrameData");
+    if (frame != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, frame, FRAME_UBO_BINDING);
+    GLuint lights = glGetUniformBlockIndex(program, "LightData");
+    if (lights != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, lights, LIGHT_UBO_BINDING);
+    GLuint object = glGetUniformBlockIndex(program, "ObjectData");
+    if (object != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, object, OBJECT_UBO_BINDING);
+    GLuint cluster = glGetUniformBlockIndex(program, "ClusterData");
+    if (cluster != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, cluster, CLUSTER_UBO_BINDING);
+    GLuint shadow = glGetUniformBlockIndex(program, "ShadowData");
+    if (shadow != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, shadow, SHADOW_UBO_BINDING);
+}
+#endif
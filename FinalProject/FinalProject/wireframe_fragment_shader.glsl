@@ -0,0 +1,73 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+noperspective in vec3 Barycentric;
+
+// light sources, positions are already in view space (LightUniforms in uniform_blocks.h)
+#define MAX_POINT_LIGHTS 8
+struct PointLightData
+{
+    vec4 position;
+    vec4 color;
+};
+layout (std140) uniform LightData
+{
+    PointLightData lights[MAX_POINT_LIGHTS];
+    int lightCount;
+};
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// directional sun (ShadowUniforms in uniform_blocks.h); the debug view is unshadowed
+#define SHADOW_CASCADES 4
+layout (std140) uniform ShadowData
+{
+    mat4 cascadeMatrices[SHADOW_CASCADES];
+    vec4 cascadeSplits;
+    vec4 cascadeTexels;
+    vec4 sunDirection;
+    vec4 sunColor;
+};
+
+uniform vec4 lineColor;
+uniform float lineWidth;    // pixels
+
+// single pass wireframe: a barycentric coordinate is 0 on the edge opposite its corner, so the smallest one
+// divided by its screen space derivative is the distance to the nearest edge in pixels. The surface and its
+// edges are shaded in the same fragment, antialiased over one pixel, with no second pass or polygon offset
+void main()
+{
+    vec3 norm = normalize(Normal);
+    vec3 viewDir = normalize(-FragPos);
+    float ambientStrength = 0.1;
+    float specularStrength = 0.5;
+    vec3 ambient = vec3(0.0);
+    vec3 diffuse = vec3(0.0);
+    vec3 specular = vec3(0.0);
+    for (int i = 0; i < lightCount; ++i)
+    {
+        vec3 lightColor = lights[i].color.rgb;
+        ambient += ambientStrength * lightColor;
+        vec3 lightDir = normalize(lights[i].position.xyz - FragPos);
+        diffuse += max(dot(norm, lightDir), 0.0) * lightColor;
+        vec3 reflectDir = reflect(-lightDir, norm);
+        specular += specularStrength * pow(max(dot(viewDir, reflectDir), 0.0), 32) * lightColor;
+    }
+    diffuse += max(dot(norm, sunDirection.xyz), 0.0) * sunColor.rgb;
+    vec3 surface = (ambient + diffuse + specular) * objectColor.rgb;
+
+    vec3 pixels = Barycentric / max(fwidth(Barycentric), vec3(1e-6));
+    float edgeDistance = min(min(pixels.x, pixels.y), pixels.z);
+    float line = 1.0 - smoothstep(lineWidth * 0.5 - 0.5, lineWidth * 0.5 + 0.5, edgeDistance);
+    FragColor = vec4(mix(surface, lineColor.rgb, line * lineColor.a), 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+// Vertex shader:
+// ================
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in vec3 aBarycentric;
+
+out vec3 FragPos;
+out vec3 Normal;
+noperspective out vec3 Barycentric;
+
+// per-draw data, streamed by the render queue (ObjectUniforms in uniform_blocks.h)
+layout (std140) uniform ObjectData
+{
+    mat4 model;
+    mat4 modelView;
+    mat4 modelViewProjection;
+    mat3 normalMatrix;
+    vec4 objectColor;
+};
+
+// the lit surface plus the corner of its triangle (Sphere::createBuffers), one of (1,0,0), (0,1,0), (0,0,1)
+void main()
+{
+    gl_Position = modelViewProjection * vec4(aPos, 1.0);
+    FragPos = vec3(modelView * vec4(aPos, 1.0));
+    Normal = normalMatrix * aNormal;
+    Barycentric = aBarycentric;
+}
\ No newline at end of file
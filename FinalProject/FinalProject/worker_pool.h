@@ -0,0 +1,116 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small fork/join pool for the per-frame CPU work (occlusion rasterization, draw list building).
+// parallelFor() hands out job indices to the workers and the calling thread alike and returns once all of
+// them ran, so callers never see work in flight. The threads are started once and sleep between frames.
+// Jobs must not touch GL: the context is only current on the main thread.
+class WorkerPool
+{
+public:
+    // threads = 0 picks one worker per hardware thread, minus the calling thread
+    explicit WorkerPool(unsigned int threads = 0)
+    {
+        if (threads == 0)
+        {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            threads = hardware > 1 ? hardware - 1 : 0;
+        }
+        for (unsigned int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    // number of threads that run jobs, including the caller of parallelFor()
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()) + 1; }
+
+    // run job(0) ... job(count - 1) across the pool and wait for all of them
+    // ------------------------------------------------------------------------
+    void parallelFor(unsigned int count, const std::function<void(unsigned int)>& job)
+    {
+        if (count == 0)
+            return;
+        if (workers.empty() || count == 1)
+        {
+            for (unsigned int i = 0; i < count; i++)
+                job(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            jobCount = count;
+            next = 0;
+            pending = static_cast<unsigned int>(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+        runJobs();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+        current = nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(unsigned int)>* current = nullptr;
+    unsigned int jobCount = 0;
+    std::atomic<unsigned int> next{ 0 };
+    unsigned int pending = 0;          // workers that haven't finished the current generation
+    unsigned long long generation = 0;
+    bool stopping = false;
+
+    void runJobs()
+    {
+        for (unsigned int i = next.fetch_add(1); i < jobCount; i = next.fetch_add(1))
+            (*current)(i);
+    }
+
+    void workerLoop()
+    {
+        unsigned long long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            runJobs();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+};
+#endif
@@ -0,0 +1,337 @@
+///////////////////////////////////////////////////////////////////////////////
+// sphere_bench.cpp
+// ================
+// Console microbenchmark of the Sphere builders: times Sphere(1, sectors,
+// stacks, smooth) for smooth and flat shading from 36x18 up to 4096x2048 and
+// checks every build against the reference builder, the per-vertex cosf/sinf
+// and push_back code the table-driven builders replaced. The reference is
+// walked alongside the built arrays instead of being stored, so only one
+// sphere is in memory at a time (4096x2048 flat is ~2.3 GB: build x64).
+//
+// Exit code 0: all builds match the reference, 1: a mismatch (printed).
+///////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "Sphere.h"
+
+
+
+// constants //////////////////////////////////////////////////////////////////
+const int SIZES[][2] = { { 36, 18 }, { 256, 128 }, { 1024, 512 }, { 4096, 2048 } };
+const double MIN_SECONDS = 1.0;             // time each case for at least this long
+const int MIN_RUNS = 3;                     // and at least this many builds
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// compares the built arrays with the reference vertex by vertex and index by
+// index; the first mismatch is printed and fails the sphere
+///////////////////////////////////////////////////////////////////////////////
+class ReferenceCheck
+{
+public:
+    explicit ReferenceCheck(const Sphere& sphere) : sphere(sphere), vertex(0), index(0), line(0), failed(false) {}
+
+    void vertexIs(float x, float y, float z, float nx, float ny, float nz, float s, float t)
+    {
+        const float expected[8] = { x, y, z, nx, ny, nz, s, t };
+        if (failed || !countFits(vertex, sphere.getVertexCount(), "vertex"))
+            return;
+        const float* interleaved = sphere.getInterleavedVertices() + vertex * 8;
+        const float* separate[8] = { sphere.getVertices() + vertex * 3, sphere.getVertices() + vertex * 3 + 1,
+                                     sphere.getVertices() + vertex * 3 + 2, sphere.getNormals() + vertex * 3,
+                                     sphere.getNormals() + vertex * 3 + 1, sphere.getNormals() + vertex * 3 + 2,
+                                     sphere.getTexCoords() + vertex * 2, sphere.getTexCoords() + vertex * 2 + 1 };
+        for (int k = 0; k < 8; ++k)
+        {
+            if (interleaved[k] != expected[k] || *separate[k] != expected[k])
+            {
+                std::cout << "    MISMATCH vertex " << vertex << " component " << k << ": " << interleaved[k]
+                          << " / " << *separate[k] << ", reference " << expected[k] << std::endl;
+                failed = true;
+                return;
+            }
+        }
+        ++vertex;
+    }
+
+    void trianglesIs(unsigned int i1, unsigned int i2, unsigned int i3)
+    {
+        const unsigned int expected[3] = { i1, i2, i3 };
+        for (int k = 0; k < 3 && !failed; ++k, ++index)
+            compareIndex(sphere.getIndices(), index, sphere.getIndexCount(), expected[k], "index");
+    }
+
+    void lineIs(unsigned int i1, unsigned int i2)
+    {
+        compareIndex(sphere.getLineIndices(), line++, sphere.getLineIndexCount(), i1, "line index");
+        compareIndex(sphere.getLineIndices(), line++, sphere.getLineIndexCount(), i2, "line index");
+    }
+
+    // all arrays compared and nothing left over
+    bool passed()
+    {
+        if (!failed && (vertex != sphere.getVertexCount() || index != sphere.getIndexCount() ||
+                        line != sphere.getLineIndexCount()))
+        {
+            std::cout << "    MISMATCH counts: " << sphere.getVertexCount() << "/" << sphere.getIndexCount() << "/"
+                      << sphere.getLineIndexCount() << ", reference " << vertex << "/" << index << "/" << line
+                      << std::endl;
+            failed = true;
+        }
+        return !failed;
+    }
+
+private:
+    bool countFits(std::size_t at, std::size_t count, const char* what)
+    {
+        if (at < count)
+            return true;
+        std::cout << "    MISMATCH " << what << " count: " << count << ", reference has more" << std::endl;
+        failed = true;
+        return false;
+    }
+
+    void compareIndex(const unsigned int* indices, std::size_t at, std::size_t count, unsigned int expected, const char* what)
+    {
+        if (failed || !countFits(at, count, what))
+            return;
+        if (indices[at] != expected)
+        {
+            std::cout << "    MISMATCH " << what << " " << at << ": " << indices[at] << ", reference " << expected << std::endl;
+            failed = true;
+        }
+    }
+
+    const Sphere& sphere;
+    std::size_t vertex, index, line;
+    bool failed;
+};
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// face normal of the reference flat builder
+///////////////////////////////////////////////////////////////////////////////
+static void referenceFaceNormal(float x1, float y1, float z1, float x2, float y2, float z2,
+                                float x3, float y3, float z3, float normal[3])
+{
+    const float EPSILON = 0.000001f;
+
+    normal[0] = normal[1] = normal[2] = 0.0f;
+    float ex1 = x2 - x1;
+    float ey1 = y2 - y1;
+    float ez1 = z2 - z1;
+    float ex2 = x3 - x1;
+    float ey2 = y3 - y1;
+    float ez2 = z3 - z1;
+    float nx = ey1 * ez2 - ez1 * ey2;
+    float ny = ez1 * ex2 - ex1 * ez2;
+    float nz = ex1 * ey2 - ey1 * ex2;
+    float length = sqrtf(nx * nx + ny * ny + nz * nz);
+    if (length > EPSILON)
+    {
+        float lengthInv = 1.0f / length;
+        normal[0] = nx * lengthInv;
+        normal[1] = ny * lengthInv;
+        normal[2] = nz * lengthInv;
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// reference smooth sphere: the per-vertex trigonometry of the original
+// buildVerticesSmooth(), +Z up
+///////////////////////////////////////////////////////////////////////////////
+static bool checkSmooth(const Sphere& sphere)
+{
+    const float PI = acos(-1.0f);
+    float radius = sphere.getRadius();
+    int sectorCount = sphere.getSectorCount();
+    int stackCount = sphere.getStackCount();
+    float lengthInv = 1.0f / radius;
+    float sectorStep = 2 * PI / sectorCount;
+    float stackStep = PI / stackCount;
+    ReferenceCheck check(sphere);
+
+    for (int i = 0; i <= stackCount; ++i)
+    {
+        float stackAngle = PI / 2 - i * stackStep;
+        float xy = radius * cosf(stackAngle);
+        float z = radius * sinf(stackAngle);
+        for (int j = 0; j <= sectorCount; ++j)
+        {
+            float sectorAngle = j * sectorStep;
+            float x = xy * cosf(sectorAngle);
+            float y = xy * sinf(sectorAngle);
+            check.vertexIs(x, y, z, x * lengthInv, y * lengthInv, z * lengthInv,
+                           (float)j / sectorCount, (float)i / stackCount);
+        }
+    }
+
+    for (int i = 0; i < stackCount; ++i)
+    {
+        unsigned int k1 = i * (sectorCount + 1);
+        unsigned int k2 = k1 + sectorCount + 1;
+        for (int j = 0; j < sectorCount; ++j, ++k1, ++k2)
+        {
+            if (i != 0)
+                check.trianglesIs(k1, k2, k1 + 1);
+            if (i != (stackCount - 1))
+                check.trianglesIs(k1 + 1, k2, k2 + 1);
+            check.lineIs(k1, k2);
+            if (i != 0)
+                check.lineIs(k1, k1 + 1);
+        }
+    }
+    return check.passed();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// reference flat sphere: the original buildVerticesFlat(), one face normal per
+// triangle (first/last stack) or quad, +Z up
+///////////////////////////////////////////////////////////////////////////////
+static bool checkFlat(const Sphere& sphere)
+{
+    const float PI = acos(-1.0f);
+    struct Vertex
+    {
+        float x, y, z, s, t;
+    };
+    float radius = sphere.getRadius();
+    int sectorCount = sphere.getSectorCount();
+    int stackCount = sphere.getStackCount();
+    float sectorStep = 2 * PI / sectorCount;
+    float stackStep = PI / stackCount;
+
+    // two rings of the grid at a time
+    std::vector<Vertex> upper(sectorCount + 1), lower(sectorCount + 1);
+    auto ring = [&](int i, std::vector<Vertex>& out) {
+        float stackAngle = PI / 2 - i * stackStep;
+        float xy = radius * cosf(stackAngle);
+        float z = radius * sinf(stackAngle);
+        for (int j = 0; j <= sectorCount; ++j)
+        {
+            float sectorAngle = j * sectorStep;
+            Vertex v = { xy * cosf(sectorAngle), xy * sinf(sectorAngle), z, (float)j / sectorCount, (float)i / stackCount };
+            out[j] = v;
+        }
+    };
+
+    ReferenceCheck check(sphere);
+    float n[3];
+    unsigned int index = 0;
+    ring(0, upper);
+    for (int i = 0; i < stackCount; ++i)
+    {
+        ring(i + 1, lower);
+        for (int j = 0; j < sectorCount; ++j)
+        {
+            //  v1--v3
+            //  |    |
+            //  v2--v4
+            const Vertex& v1 = upper[j];
+            const Vertex& v2 = lower[j];
+            const Vertex& v3 = upper[j + 1];
+            const Vertex& v4 = lower[j + 1];
+            if (i == 0)
+            {
+                referenceFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v4.x, v4.y, v4.z, n);
+                check.vertexIs(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                check.vertexIs(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                check.vertexIs(v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
+                check.trianglesIs(index, index + 1, index + 2);
+                check.lineIs(index, index + 1);
+                index += 3;
+            }
+            else if (i == (stackCount - 1))
+            {
+                referenceFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z, n);
+                check.vertexIs(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                check.vertexIs(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                check.vertexIs(v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
+                check.trianglesIs(index, index + 1, index + 2);
+                check.lineIs(index, index + 1);
+                check.lineIs(index, index + 2);
+                index += 3;
+            }
+            else
+            {
+                referenceFaceNormal(v1.x, v1.y, v1.z, v2.x, v2.y, v2.z, v3.x, v3.y, v3.z, n);
+                check.vertexIs(v1.x, v1.y, v1.z, n[0], n[1], n[2], v1.s, v1.t);
+                check.vertexIs(v2.x, v2.y, v2.z, n[0], n[1], n[2], v2.s, v2.t);
+                check.vertexIs(v3.x, v3.y, v3.z, n[0], n[1], n[2], v3.s, v3.t);
+                check.vertexIs(v4.x, v4.y, v4.z, n[0], n[1], n[2], v4.s, v4.t);
+                check.trianglesIs(index, index + 1, index + 2);
+                check.trianglesIs(index + 2, index + 1, index + 3);
+                check.lineIs(index, index + 1);
+                check.lineIs(index, index + 2);
+                index += 4;
+            }
+        }
+        upper.swap(lower);
+    }
+    return check.passed();
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// time the builds of one size, then check the last one
+///////////////////////////////////////////////////////////////////////////////
+static bool benchmark(int sectors, int stacks, bool smooth)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double total = 0, best = 1e30;
+    int runs = 0;
+    while (runs < MIN_RUNS || total < MIN_SECONDS)
+    {
+        Clock::time_point start = Clock::now();
+        Sphere sphere(1.0f, sectors, stacks, smooth);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        total += seconds;
+        best = seconds < best ? seconds : best;
+        ++runs;
+    }
+
+    // build outside the timing, so the check doesn't count
+    Sphere sphere(1.0f, sectors, stacks, smooth);
+    bool passed = smooth ? checkSmooth(sphere) : checkFlat(sphere);
+
+    std::cout << std::setw(5) << sectors << "x" << std::left << std::setw(5) << stacks << std::right
+              << std::setw(7) << (smooth ? "smooth" : "flat")
+              << std::setw(11) << sphere.getVertexCount()
+              << std::setw(6) << runs
+              << std::fixed << std::setprecision(3)
+              << std::setw(12) << best * 1000.0
+              << std::setw(12) << total / runs * 1000.0
+              << std::setw(10) << std::setprecision(1) << sphere.getVertexCount() / best / 1e6
+              << "   " << (passed ? "ok" : "FAILED") << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    return passed;
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+    std::cout << "       size   mode   vertices  runs     best ms     mean ms  Mvert/s   reference" << std::endl;
+
+    bool passed = true;
+    for (const auto& size : SIZES)
+    {
+        passed = benchmark(size[0], size[1], true) && passed;
+        passed = benchmark(size[0], size[1], false) && passed;
+    }
+    return passed ? 0 : 1;
+}